@@ -1,236 +1,2928 @@
 #include <linux/module.h>
 #include <linux/usb.h>
+#include <linux/usb/cdc.h>
 #include <linux/slab.h>
+#include <linux/completion.h>
+#include <linux/mutex.h>
+#include <linux/rwsem.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/sort.h>
+#include <linux/kref.h>
+#include <linux/idr.h>
+#include <linux/device.h>
+#include <linux/workqueue.h>
+#include <linux/cdev.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/kfifo.h>
+#include <linux/list.h>
+#include <linux/wait.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/crc-ccitt.h>
+#include <linux/ctype.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/log2.h>
+#include <linux/leds.h>
+#include <linux/interrupt.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+
+#include "smartlamp_uapi.h"
+
+#define CREATE_TRACE_POINTS
+#include "smartlamp_trace.h"
 
 MODULE_AUTHOR("DevTITANS <devtitans@icomp.ufam.edu.br>");
-MODULE_DESCRIPTION("Driver de acesso ao SmartLamp (ESP32 com Chip Serial CP2102");
+MODULE_DESCRIPTION("Driver de acesso ao SmartLamp (ESP32 com Chip Serial CP2102 ou CH9102)");
 MODULE_LICENSE("GPL");
 
 
 #define MAX_RECV_LINE 100 // Tamanho máximo de uma linha de resposta do dispositvo USB
-#define SMARTLAMP_INTERFACE 1
+#define SMARTLAMP_BAUD_BOOT 9600   // Velocidade do firmware ao (re)iniciar
+#define SMARTLAMP_MAX_DEVICES 256  // Quantidade máxima de SmartLamps conectados ao mesmo tempo
+#define SMARTLAMP_IN_URBS 4        // Quantidade de URBs de leitura mantidas sempre submetidas
+#define SMARTLAMP_TIMEOUT_MS 1000  // Tempo máximo de espera pelo envio de um comando
+#define SMARTLAMP_RETRIES 5        // Quantidade máxima de envios de um mesmo comando
+#define SMARTLAMP_RESP_MIN_MS 250  // Espera pela resposta na primeira tentativa (dobra a cada reenvio)
+#define SMARTLAMP_RESP_MAX_MS 2000 // Limite da espera pela resposta em uma tentativa
+#define SMARTLAMP_RTT_SAMPLES 256  // Quantidade de tempos de resposta guardados para as estatísticas
+#define SMARTLAMP_HIST_BUCKETS 24  // Faixas do histograma log2 de tempos de resposta (a última acumula >= 2^23 us)
+#define SMARTLAMP_CMD_STATS 16     // Comandos distintos contados em debugfs (o último acumula os demais)
+#define SMARTLAMP_LED_MAX 100      // Maior intensidade aceita pelo firmware (SET_LED 0..100)
+#define SMARTLAMP_FADE_MAX_MS 30000 // Maior duração de um SET_LED_FADE
+#define SMARTLAMP_HELLO "SmartLamp Initialized." // Linha enviada pelo firmware ao (re)iniciar
+#define SMARTLAMP_UNKNOWN "ERR Unknown command." // Resposta do firmware a um comando que ele não conhece
+#define SMARTLAMP_READER_RECORDS 256 // Registros guardados para cada leitor de /dev/smartlampN (potência de 2)
+#define SMARTLAMP_RING_PAGES 8     // Páginas de registros do anel mapeável com mmap()
+// Capacidade do anel em registros (não precisa ser potência de 2: a posição é o contador módulo a capacidade)
+#define SMARTLAMP_RING_RECORDS (SMARTLAMP_RING_PAGES * PAGE_SIZE / sizeof(struct smartlamp_record))
+#define SMARTLAMP_FRAME_MAX 30     // Maior quadro binário (antes do COBS): código, etiqueta, valores e CRC
+#define SMARTLAMP_VALUE_NAN S16_MIN // Canal sem leitura em GET_ALL (sensor com erro): "nan" no texto
+#define SMARTLAMP_MAX_VALUES (SMARTLAMP_NCHANNELS + 1) // Maior quantidade de valores em um quadro (GET_ALL e idade)
+
+// Códigos de operação do modo binário (os mesmos de smartlamp.ino). A resposta volta com o código
+// combinado com SMARTLAMP_OP_RES e um erro, com SMARTLAMP_OP_ERR
+#define SMARTLAMP_OP_GET_LED  0x01
+#define SMARTLAMP_OP_SET_LED  0x02
+#define SMARTLAMP_OP_GET_LDR  0x03
+#define SMARTLAMP_OP_GET_TEMP 0x04
+#define SMARTLAMP_OP_GET_HUM  0x05
+#define SMARTLAMP_OP_GET_ALL  0x06
+#define SMARTLAMP_OP_STREAM_START 0x07
+#define SMARTLAMP_OP_STREAM_STOP  0x08
+#define SMARTLAMP_OP_SET_LED_FADE 0x09
+#define SMARTLAMP_OP_GET_LDR_RAW  0x0A
+#define SMARTLAMP_OP_LDR_FILTER   0x0B
+#define SMARTLAMP_OP_RES      0x80
+#define SMARTLAMP_OP_ERR      0x40
+#define SMARTLAMP_ERR_UNKNOWN 1    // Valor do quadro de erro para um código que o firmware não conhece
+#define SMARTLAMP_STREAM_SEQ  0xff // Etiqueta dos quadros do envio contínuo (STREAM_SEQ): nenhum comando a usa
+
+// Protocolo usado para conversar com o firmware, negociado ao conectar
+enum smartlamp_proto {
+    SMARTLAMP_PROTO_TEXT,                          // "GET_LDR" / "RES GET_LDR 42": um comando por vez
+    SMARTLAMP_PROTO_TAGGED,                        // "#7 GET_LDR" / "#7 RES GET_LDR 42": vários em andamento
+    SMARTLAMP_PROTO_BINARY,                        // Quadros COBS com CRC-16: vários em andamento
+    SMARTLAMP_PROTO_AUTO = -1,                     // __usb_send_cmd: usa o protocolo negociado
+};
+
+static const char * const smartlamp_proto_names[] = {
+    [SMARTLAMP_PROTO_TEXT]   = "text",
+    [SMARTLAMP_PROTO_TAGGED] = "tagged",
+    [SMARTLAMP_PROTO_BINARY] = "binary",
+};
+
+// Filtro aplicado pelo firmware às amostras do LDR
+enum smartlamp_ldr_filter {
+    SMARTLAMP_LDR_FILTER_NONE,
+    SMARTLAMP_LDR_FILTER_AVG,                      // Média móvel das últimas amostras
+    SMARTLAMP_LDR_FILTER_MEDIAN,                   // Mediana das últimas amostras
+};
+
+#define SMARTLAMP_LDR_WINDOW_MAX 32                // Maior janela do filtro no firmware
+#define SMARTLAMP_LDR_WINDOW_DEFAULT 8             // Filtro do firmware ao (re)iniciar: média de 8 amostras
+
+// Nome em ldr_filter e comando enviado ao firmware (a janela vai como parâmetro)
+static const struct {
+    const char *name;
+    char *cmd;
+} smartlamp_ldr_filters[] = {
+    [SMARTLAMP_LDR_FILTER_NONE]   = { "none",   "LDR_FILTER NONE"   },
+    [SMARTLAMP_LDR_FILTER_AVG]    = { "avg",    "LDR_FILTER AVG"    },
+    [SMARTLAMP_LDR_FILTER_MEDIAN] = { "median", "LDR_FILTER MEDIAN" },
+};
+
+// Descrição de cada canal: comando de leitura e intervalo de amostragem em segundo plano
+struct smartlamp_channel_info {
+    const char *name;                              // Nome do arquivo no sysfs
+    char *cmd;                                     // Comando de leitura
+    u8 opcode;                                     // Comando de leitura no modo binário
+    unsigned int decimals;                         // Casas decimais: o valor é guardado em ponto fixo (23.4 -> 234)
+    unsigned int interval_ms;                      // Intervalo padrão de amostragem (0: sem amostragem)
+    unsigned int min_interval_ms;                  // Menor intervalo aceito (o DHT11 precisa de 1 s entre leituras)
+    unsigned int max_stream_hz;                    // Maior taxa de envio contínuo pelo firmware (0: sem streaming)
+    bool aged;                                     // O firmware responde do seu cache e informa a idade da leitura
+};
+
+static const struct smartlamp_channel_info smartlamp_channels[SMARTLAMP_NCHANNELS] = {
+    [SMARTLAMP_CH_LED]  = { "led",  "GET_LED",  SMARTLAMP_OP_GET_LED,  0, 0,    0,    0,   false },
+    [SMARTLAMP_CH_LDR]  = { "ldr",  "GET_LDR",  SMARTLAMP_OP_GET_LDR,  0, 1000, 50,   200, false },
+    [SMARTLAMP_CH_TEMP] = { "temp", "GET_TEMP", SMARTLAMP_OP_GET_TEMP, 1, 2000, 1000, 1,   true  },
+    [SMARTLAMP_CH_HUM]  = { "hum",  "GET_HUM",  SMARTLAMP_OP_GET_HUM,  1, 2000, 1000, 1,   true  },
+};
+
+// Último valor lido de um canal
+struct smartlamp_sample {
+    int value;
+    ktime_t stamp;                                 // Momento em que a resposta chegou
+    bool valid;
+};
+
+// Remonta as linhas (ou quadros, no modo binário) enviadas pelo dispositivo: uma resposta pode chegar
+// dividida em vários pacotes USB e um único pacote pode conter várias respostas
+struct smartlamp_framer {
+    char recv_line[MAX_RECV_LINE];                 // Armazena dados vindos da USB até receber '\n' (ou 0 no modo binário)
+    int  len;                                      // Quantidade de bytes acumulados em recv_line
+    bool discard;                                  // Linha atual longa demais ou com lixo: descarta até o próximo '\n'
+    bool binary;                                   // Recebendo quadros COBS terminados em 0 em vez de linhas
+    unsigned int hello_pos;                        // Modo binário: quanto de SMARTLAMP_HELLO já foi reconhecido
+    unsigned long dropped;                         // Total de linhas (e quadros) descartados
+};
+
+// Contadores de um comando, mostrados em /sys/kernel/debug/smartlamp/lampN/commands
+struct smartlamp_cmd_stats {
+    char cmd[SMARTLAMP_TRACE_CMD_LEN];             // Nome do comando ("" : posição livre)
+    u64  sent;                                     // Comandos enviados (sem contar os reenvios)
+    u64  ok;                                       // Respondidos com sucesso
+    u64  errors;                                   // Erro do firmware, comando desconhecido, desconexão, ...
+    u64  timeouts;                                 // Nenhuma resposta depois de todas as tentativas
+    u64  retries;                                  // Reenvios por falta de resposta
+    u64  shared;                                   // Leituras atendidas por um comando igual já em andamento
+};
+
+// Estado de um SmartLamp conectado. Cada lâmpada tem suas próprias URBs, buffers e travas, de forma que
+// a lentidão de uma não afeta as demais. Liberado quando a última referência (kref) é devolvida.
+struct smartlamp {
+    struct kref kref;                              // Referências ao dispositivo (probe, arquivos abertos, ...)
+    struct usb_device *udev;                       // Referência para o dispositivo USB
+    struct usb_interface *interface;               // Interface USB usada pelo driver
+    const struct smartlamp_bridge_ops *ops;        // Chip da ponte USB-serial (CP210x ou CH9102)
+    struct device *dev;                            // Dispositivo em /sys/class/smartlamp/lampN
+    int index;                                     // N em lampN e /dev/smartlampN
+    struct cdev *cdev;                             // Dispositivo de caractere /dev/smartlampN
+
+    uint usb_in, usb_out;                          // Endereços das portas de entrada e saida da USB
+    char *usb_out_buffer;                          // Buffer de saída da USB
+    int usb_max_size;                              // Tamanho máximo de uma mensagem USB
+    int usb_in_size;                               // Tamanho do buffer de cada URB de leitura
+
+    struct urb *in_urbs[SMARTLAMP_IN_URBS];        // URBs de leitura (cada uma com seu próprio buffer)
+    struct usb_anchor in_anchor;                   // Agrupa as URBs de leitura para cancelá-las de uma vez
+    struct urb *out_urb;                           // URB usada para enviar os comandos
+    struct mutex out_lock;                         // Protege out_urb e usb_out_buffer (um envio por vez)
+    struct completion out_done;                    // Sinalizada quando o envio do comando termina
+    int out_status;                                // Status da última URB de envio
+
+    struct rw_semaphore cmd_sem;                   // Sem etiquetas: um comando por vez (escrita); com etiquetas: vários (leitura)
+    spinlock_t resp_lock;                          // Protege o framer e os comandos pendentes (usado no callback)
+    struct smartlamp_framer framer;                // Remontagem das linhas recebidas
+    struct list_head pending_cmds;                 // Comandos aguardando resposta (struct smartlamp_cmd), do mais antigo
+    u16  next_seq;                                 // Próxima etiqueta ("#<seq> CMD" ou byte de etiqueta do quadro)
+    enum smartlamp_proto proto;                    // Protocolo negociado. Só muda com cmd_sem em escrita ou no reinício do firmware
+    bool disconnected;                             // Dispositivo removido: novos comandos falham imediatamente
+    spinlock_t flight_lock;                        // Protege flights
+    struct list_head flights;                      // Leituras em andamento que outros processos podem aguardar
+    unsigned int baud;                             // Velocidade programada na ponte USB-serial. Muda com cmd_sem em escrita
+
+    spinlock_t rtt_lock;                           // Protege as amostras de tempo de resposta e as estatísticas
+    u32  rtt_samples[SMARTLAMP_RTT_SAMPLES];       // Últimos tempos de resposta (us), em buffer circular
+    unsigned int rtt_next;                         // Próxima posição a ser escrita em rtt_samples
+    unsigned int rtt_count;                        // Quantidade de amostras válidas em rtt_samples
+    u64  rtt_hist[SMARTLAMP_HIST_BUCKETS];         // Histograma: rtt_hist[i] conta tempos em [2^i, 2^(i+1)) us
+    struct smartlamp_cmd_stats cmd_stats[SMARTLAMP_CMD_STATS]; // Contadores por comando
+    struct dentry *debugfs;                        // /sys/kernel/debug/smartlamp/lampN
+
+    struct delayed_work sample_work;               // Amostragem periódica dos sensores em segundo plano
+    spinlock_t cache_lock;                         // Protege cache
+    struct smartlamp_sample cache[SMARTLAMP_NCHANNELS]; // Últimos valores lidos de cada canal
+    unsigned int interval_ms[SMARTLAMP_NCHANNELS]; // Intervalo de amostragem de cada canal (0: desativado)
+    ktime_t next_sample[SMARTLAMP_NCHANNELS];      // Quando cada canal deve ser amostrado de novo
+    unsigned int max_age_ms;                       // Idade máxima de um valor em cache (0: sem limite)
+
+    struct mutex stream_lock;                      // Serializa as mudanças de stream_hz (e o STREAM_START enviado)
+    unsigned int stream_hz[SMARTLAMP_NCHANNELS];   // Taxa de envio contínuo pelo firmware (0: desligado)
+    enum smartlamp_ldr_filter ldr_filter;          // Filtro do LDR no firmware. Protegido por stream_lock
+    unsigned int ldr_window;                       // Janela do filtro do LDR. Protegido por stream_lock
+
+    struct mutex led_lock;                         // Serializa as mudanças do LED (cópia local + SET_LED)
+    spinlock_t led_req_lock;                       // Protege led_req, led_req_gen, led_done_gen e led_err
+    struct work_struct led_work;                   // Envia a intensidade pedida mais recente
+    int  led_req;                                  // Intensidade pedida e ainda não enviada (-1: nenhuma)
+    u64  led_req_gen;                              // Quantidade de pedidos recebidos
+    u64  led_done_gen;                             // Pedidos já aplicados (ou substituídos por um mais novo)
+    int  led_err;                                  // Resultado do último SET_LED enviado por led_work
+    wait_queue_head_t led_wait;                    // Processos esperando os pedidos terminarem (fsync)
+    struct led_classdev led_cdev;                  // /sys/class/leds/smartlampN:white:lamp (gatilhos do kernel)
+    char led_name[32];                             // Nome de led_cdev
+    struct iio_dev *iio;                           // Sensores no subsistema IIO (NULL se o registro falhou)
+    struct work_struct led_sync_work;              // Ressincroniza o LED quando o firmware reinicia
+    struct work_struct halt_work;                  // Destrava o endpoint IN (stall) e volta a ler
+
+    spinlock_t readers_lock;                       // Protege readers
+    struct list_head readers;                      // Arquivos /dev/smartlampN abertos (struct smartlamp_reader)
+    wait_queue_head_t read_wait;                   // Leitores esperando novos registros
 
-static char recv_line[MAX_RECV_LINE];              // Armazena dados vindos da USB até receber um caractere de nova linha '\n'
-static struct usb_device *smartlamp_device;        // Referência para o dispositivo USB
-static uint usb_in, usb_out;                       // Endereços das portas de entrada e saida da USB
-static char *usb_in_buffer, *usb_out_buffer;       // Buffers de entrada e saída da USB
-static int usb_max_size;                           // Tamanho máximo de uma mensagem USB
+    void *ring;                                    // Anel mapeável: página de controle + SMARTLAMP_RING_PAGES
+    struct smartlamp_ring_page *ring_page;         // Página de controle do anel (início de ring)
+    struct smartlamp_record *ring_data;            // Registros do anel. Escrito sob readers_lock
+    u64 ring_head;                                 // Cópia do driver de data_head
+    u32 ring_pos;                                  // ring_head módulo SMARTLAMP_RING_RECORDS
+};
+
+// Operações específicas de cada chip da ponte USB-serial (escolhidas pelo driver_info de id_table)
+struct smartlamp_bridge_ops {
+    const char *name;
+    u8   interface;                                // Interface com os endpoints bulk de dados
+    int  (*init)(struct smartlamp *sl);            // Prepara a ponte para transmitir (opcional)
+    int  (*set_line)(struct smartlamp *sl, unsigned int baud); // Programa baud, 8N1, sem controle de fluxo
+    unsigned int rx_size;                          // Tamanho de cada URB de leitura (arredondado para o pacote)
+    unsigned int max_baud;                         // Maior velocidade suportada pela ponte
+};
+
+// Resposta de um comando: um valor (GET_ALL traz um por canal) e o momento em que chegou
+struct smartlamp_reply {
+    int values[SMARTLAMP_NCHANNELS];
+    unsigned int nvalues;
+    ktime_t stamp;
+};
+
+// Um comando aguardando resposta. Vive na pilha de usb_send_cmd enquanto está em smartlamp->pending_cmds
+struct smartlamp_cmd {
+    struct list_head node;                         // Entrada em smartlamp->pending_cmds (vazia depois de respondido)
+    enum smartlamp_proto proto;                    // Protocolo em que o comando foi enviado
+    u16  seq;                                      // Etiqueta do comando (no modo binário, só o byte menos significativo)
+    u8   opcode;                                   // Código do comando no modo binário
+    int  arg;                                      // Primeiro valor do quadro binário, antes do parâmetro (-1: nenhum)
+    unsigned int decimals;                         // Casas decimais do valor da resposta
+    bool all;                                      // GET_ALL: a resposta traz um valor por canal
+    char expected[MAX_RECV_LINE];                  // Prefixo da resposta esperada (e.g., "RES GET_LDR ")
+    char error[MAX_RECV_LINE];                     // Prefixo do erro reportado pelo firmware (e.g., "ERR GET_TEMP")
+    struct completion done;                        // Sinalizada pelo callback quando a resposta chega
+    struct smartlamp_reply reply;                  // Valores extraídos da resposta
+    int  status;                                   // 0, -EIO (erro do firmware), -EOPNOTSUPP ou -ENODEV
+    ktime_t start;                                 // Momento do primeiro envio
+    bool rx_seen;                                  // Já chegou algum byte depois do envio (só com o tracepoint ligado)
+};
+
+// Uma leitura em andamento (GET_* sem parâmetro). Processos que pedem a mesma leitura enquanto ela está
+// em andamento esperam por ela em vez de enviar outro comando (no estilo singleflight)
+struct smartlamp_flight {
+    struct kref kref;                              // Quem envia e cada processo que espera
+    struct list_head node;                         // Entrada em smartlamp->flights (vazia depois de terminada)
+    const char *cmd;                               // Comando enviado
+    struct completion done;                        // Sinalizada quando a resposta (ou o erro) chega
+    int ret;                                       // Resultado de __usb_send_cmd
+    struct smartlamp_reply reply;                  // Resposta entregue a todos
+};
+
+// Um arquivo /dev/smartlampN aberto. Cada leitor recebe todas as amostras em sua própria fila
+struct smartlamp_reader {
+    struct smartlamp *sl;
+    struct list_head node;                         // Entrada em smartlamp->readers
+    struct mutex read_lock;                        // Um único read() consumindo a fila por vez
+    DECLARE_KFIFO_PTR(fifo, struct smartlamp_record); // Registros ainda não lidos
+    unsigned long lost;                            // Registros descartados com a fila cheia
+};
+
+// CP210x (Silicon Labs): protocolo próprio, com requisições de fabricante na própria interface de dados
+#define CP210X_REQTYPE_HOST_TO_INTERFACE (USB_DIR_OUT | USB_TYPE_VENDOR | USB_RECIP_INTERFACE)
+#define CP210X_IFC_ENABLE     0x00                 // Liga a UART
+#define CP210X_SET_LINE_CTL   0x03                 // Bits de parada (0-3), paridade (4-7) e de dados (8-15)
+#define CP210X_SET_BAUDRATE   0x1e                 // Baud em 4 bytes little endian
+#define CP210X_UART_ENABLE    0x0001
+#define CP210X_LINE_8N1       0x0800
+
+static int smartlamp_cp210x_ctrl(struct smartlamp *sl, u8 request, u16 value, const void *data, u16 size) {
+    void *buf = NULL;
+    int ret;
+
+    if (size) {
+        buf = kmemdup(data, size, GFP_KERNEL);     // Buffer de controle precisa aceitar DMA: não pode ficar na pilha
+        if (!buf)
+            return -ENOMEM;
+    }
+
+    ret = usb_control_msg(sl->udev, usb_sndctrlpipe(sl->udev, 0), request, CP210X_REQTYPE_HOST_TO_INTERFACE,
+                          value, sl->ops->interface, buf, size, USB_CTRL_SET_TIMEOUT);
+    kfree(buf);
+    return ret < 0 ? ret : 0;
+}
+
+static int smartlamp_cp210x_init(struct smartlamp *sl) {
+    return smartlamp_cp210x_ctrl(sl, CP210X_IFC_ENABLE, CP210X_UART_ENABLE, NULL, 0);
+}
+
+// Sem SET_FLOW: o CP210x já começa sem controle de fluxo, e SET_FLOW também define DTR e RTS
+static int smartlamp_cp210x_set_line(struct smartlamp *sl, unsigned int baud) {
+    __le32 rate = cpu_to_le32(baud);
+    int ret;
+
+    ret = smartlamp_cp210x_ctrl(sl, CP210X_SET_LINE_CTL, CP210X_LINE_8N1, NULL, 0);
+    if (ret)
+        return ret;
+
+    return smartlamp_cp210x_ctrl(sl, CP210X_SET_BAUDRATE, 0, &rate, sizeof(rate));
+}
+
+// CH9102 (WCH): segue a classe CDC ACM, com a interface de controle 0 e a de dados 1. A linha serial é
+// programada com SET_LINE_CODING; CDC não tem requisição de controle de fluxo
+#define CH9102_CTRL_INTERFACE 0
 
-#define VENDOR_ID   0x10C4
-#define PRODUCT_ID  0xEA60
+static int smartlamp_ch9102_set_line(struct smartlamp *sl, unsigned int baud) {
+    struct usb_cdc_line_coding *coding;
+    int ret;
 
+    coding = kzalloc(sizeof(*coding), GFP_KERNEL);  // Buffer de controle precisa aceitar DMA: não pode ficar na pilha
+    if (!coding)
+        return -ENOMEM;
 
-static const struct usb_device_id id_table[] = { { USB_DEVICE(VENDOR_ID, PRODUCT_ID) }, {} };
+    coding->dwDTERate = cpu_to_le32(baud);
+    coding->bCharFormat = USB_CDC_1_STOP_BITS;
+    coding->bParityType = USB_CDC_NO_PARITY;
+    coding->bDataBits = 8;
+
+    ret = usb_control_msg(sl->udev, usb_sndctrlpipe(sl->udev, 0), USB_CDC_REQ_SET_LINE_CODING,
+                          USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE, 0, CH9102_CTRL_INTERFACE,
+                          coding, sizeof(*coding), USB_CTRL_SET_TIMEOUT);
+    kfree(coding);
+    return ret < 0 ? ret : 0;
+}
+
+// O CP2102 tem FIFO de recepção de 576 bytes e pacotes de 64: URBs de 256 bytes esvaziam a FIFO sem
+// segurar amostras por muito tempo. O CH9102 aceita até 4 Mbaud e entrega mais por URB
+static const struct smartlamp_bridge_ops smartlamp_cp210x_ops = {
+    .name      = "CP210x",
+    .interface = 0,
+    .init      = smartlamp_cp210x_init,
+    .set_line  = smartlamp_cp210x_set_line,
+    .rx_size   = 256,
+    .max_baud  = 921600,
+};
+
+static const struct smartlamp_bridge_ops smartlamp_ch9102_ops = {
+    .name      = "CH9102",
+    .interface = 1,
+    .set_line  = smartlamp_ch9102_set_line,
+    .rx_size   = 512,
+    .max_baud  = 4000000,
+};
+
+static const struct usb_device_id id_table[] = {
+    { USB_DEVICE(0x10c4, 0xea60), .driver_info = (kernel_ulong_t)&smartlamp_cp210x_ops },  // CP2102
+    { USB_DEVICE(0x1a86, 0x55d4), .driver_info = (kernel_ulong_t)&smartlamp_ch9102_ops },  // CH9102
+    {}
+};
 
 static int  usb_probe(struct usb_interface *ifce, const struct usb_device_id *id); // Executado quando o dispositivo é conectado na USB
 static void usb_disconnect(struct usb_interface *ifce);                           // Executado quando o dispositivo USB é desconectado da USB
-static int  usb_read_serial(void);   
-static int  usb_send_cmd(char *cmd, int param);
-
-// Executado quando o arquivo /sys/kernel/smartlamp/{led, ldr} é lido (e.g., cat /sys/kernel/smartlamp/led)
-static ssize_t attr_show(struct kobject *sys_obj, struct kobj_attribute *attr, char *buff);
-// Executado quando o arquivo /sys/kernel/smartlamp/{led, ldr} é escrito (e.g., echo "100" | sudo tee -a /sys/kernel/smartlamp/led)
-static ssize_t attr_store(struct kobject *sys_obj, struct kobj_attribute *attr, const char *buff, size_t count);   
-// Variáveis para criar os arquivos no /sys/kernel/smartlamp/{led, ldr}
-static struct kobj_attribute  led_attribute = __ATTR(led, S_IRUGO | S_IWUSR, attr_show, attr_store);
-static struct kobj_attribute  ldr_attribute = __ATTR(ldr, S_IRUGO | S_IWUSR, attr_show, attr_store);
-static struct kobj_attribute temp_attribute = __ATTR(temp, S_IRUGO, attr_show, NULL);
-static struct kobj_attribute hum_attribute  = __ATTR(hum,  S_IRUGO, attr_show, NULL);
-
-
-
-static struct attribute *attrs[] = {
-    &led_attribute.attr,
-    &ldr_attribute.attr,
-    &temp_attribute.attr,
-    &hum_attribute.attr,
+static int  usb_send_cmd(struct smartlamp *sl, char *cmd, int param, int *value);
+static int  usb_send_cmd_reply(struct smartlamp *sl, char *cmd, int param, struct smartlamp_reply *reply);
+static void usb_read_callback(struct urb *urb);                                   // Executado quando uma URB de leitura termina
+static void usb_write_callback(struct urb *urb);                                  // Executado quando a URB de envio termina
+static void smartlamp_framer_reset(struct smartlamp_framer *fr);
+static void smartlamp_sample_work(struct work_struct *work);                      // Amostragem periódica dos sensores
+static void smartlamp_led_sync_work(struct work_struct *work);                    // Reenvia o LED ao firmware reiniciado
+static void smartlamp_led_work(struct work_struct *work);                         // Envia o último pedido de LED
+static void smartlamp_halt_work(struct work_struct *work);                        // Destrava o endpoint IN
+static void smartlamp_led_cdev_set(struct led_classdev *cdev, enum led_brightness value); // Classe LED
+static enum led_brightness smartlamp_led_cdev_get(struct led_classdev *cdev);
+static int  smartlamp_iio_register(struct smartlamp *sl);                         // Registra os sensores no IIO
+static void smartlamp_iio_unregister(struct smartlamp *sl);
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/{led, ldr, temp, hum} é lido (e.g., cat /sys/class/smartlamp/lamp0/led)
+static ssize_t attr_show(struct device *dev, struct device_attribute *attr, char *buff);
+// Executado quando o arquivo /sys/class/smartlamp/lampN/{led, ldr} é escrito (e.g., echo "100" | sudo tee -a /sys/class/smartlamp/lamp0/led)
+static ssize_t attr_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count);
+// Executado quando o arquivo /sys/class/smartlamp/lampN/rtt_{p50,p99}_us é lido
+static ssize_t rtt_show(struct device *dev, struct device_attribute *attr, char *buff);
+// Executado quando o arquivo /sys/class/smartlamp/lampN/{ldr, temp, hum}_interval_ms é lido/escrito
+static ssize_t interval_show(struct device *dev, struct device_attribute *attr, char *buff);
+static ssize_t interval_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count);
+// Executado quando o arquivo /sys/class/smartlamp/lampN/{ldr, temp, hum}_stream_hz é lido/escrito
+static ssize_t stream_hz_show(struct device *dev, struct device_attribute *attr, char *buff);
+static ssize_t stream_hz_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count);
+// Executado quando o arquivo /sys/class/smartlamp/lampN/fade é escrito
+static ssize_t fade_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count);
+// Executado quando o arquivo /sys/class/smartlamp/lampN/ldr_raw é lido
+static ssize_t ldr_raw_show(struct device *dev, struct device_attribute *attr, char *buff);
+// Executado quando o arquivo /sys/class/smartlamp/lampN/ldr_filter é lido/escrito
+static ssize_t ldr_filter_show(struct device *dev, struct device_attribute *attr, char *buff);
+static ssize_t ldr_filter_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count);
+// Executado quando o arquivo /sys/class/smartlamp/lampN/snapshot é lido
+static ssize_t snapshot_show(struct device *dev, struct device_attribute *attr, char *buff);
+// Executado quando o arquivo /sys/class/smartlamp/lampN/protocol é lido
+static ssize_t protocol_show(struct device *dev, struct device_attribute *attr, char *buff);
+// Executado quando o arquivo /sys/class/smartlamp/lampN/baud é lido
+static ssize_t baud_show(struct device *dev, struct device_attribute *attr, char *buff);
+// Executado quando o arquivo /sys/class/smartlamp/lampN/max_age_ms é lido/escrito
+static ssize_t max_age_ms_show(struct device *dev, struct device_attribute *attr, char *buff);
+static ssize_t max_age_ms_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count);
+// Variáveis para criar os arquivos de cada SmartLamp. Os mesmos arquivos aparecem no diretório da interface USB
+// e em /sys/class/smartlamp/lampN
+static DEVICE_ATTR(led,  S_IRUGO | S_IWUSR, attr_show, attr_store);
+static DEVICE_ATTR(ldr,  S_IRUGO | S_IWUSR, attr_show, attr_store);
+static DEVICE_ATTR(temp, S_IRUGO, attr_show, NULL);
+static DEVICE_ATTR(hum,  S_IRUGO, attr_show, NULL);
+static DEVICE_ATTR(rtt_p50_us, S_IRUGO, rtt_show, NULL);
+static DEVICE_ATTR(rtt_p99_us, S_IRUGO, rtt_show, NULL);
+static DEVICE_ATTR(ldr_interval_ms,  S_IRUGO | S_IWUSR, interval_show, interval_store);
+static DEVICE_ATTR(temp_interval_ms, S_IRUGO | S_IWUSR, interval_show, interval_store);
+static DEVICE_ATTR(hum_interval_ms,  S_IRUGO | S_IWUSR, interval_show, interval_store);
+static DEVICE_ATTR(ldr_stream_hz,  S_IRUGO | S_IWUSR, stream_hz_show, stream_hz_store);
+static DEVICE_ATTR(temp_stream_hz, S_IRUGO | S_IWUSR, stream_hz_show, stream_hz_store);
+static DEVICE_ATTR(hum_stream_hz,  S_IRUGO | S_IWUSR, stream_hz_show, stream_hz_store);
+static DEVICE_ATTR_RW(max_age_ms);
+static DEVICE_ATTR_RO(protocol);
+static DEVICE_ATTR_RO(baud);
+static DEVICE_ATTR_RO(snapshot);
+static DEVICE_ATTR_WO(fade);
+static DEVICE_ATTR_RO(ldr_raw);
+static DEVICE_ATTR_RW(ldr_filter);
+
+static struct attribute *smartlamp_attrs[] = {
+    &dev_attr_led.attr,
+    &dev_attr_ldr.attr,
+    &dev_attr_temp.attr,
+    &dev_attr_hum.attr,
+    &dev_attr_rtt_p50_us.attr,
+    &dev_attr_rtt_p99_us.attr,
+    &dev_attr_ldr_interval_ms.attr,
+    &dev_attr_temp_interval_ms.attr,
+    &dev_attr_hum_interval_ms.attr,
+    &dev_attr_ldr_stream_hz.attr,
+    &dev_attr_temp_stream_hz.attr,
+    &dev_attr_hum_stream_hz.attr,
+    &dev_attr_max_age_ms.attr,
+    &dev_attr_protocol.attr,
+    &dev_attr_baud.attr,
+    &dev_attr_snapshot.attr,
+    &dev_attr_fade.attr,
+    &dev_attr_ldr_raw.attr,
+    &dev_attr_ldr_filter.attr,
     NULL
 };
+ATTRIBUTE_GROUPS(smartlamp);
 
+MODULE_DEVICE_TABLE(usb, id_table);
 
-static struct attribute_group attr_group    = { .attrs = attrs };
-static struct kobject        *sys_obj;                                             // Executado para ler a saida da porta serial
+static DEFINE_IDR(smartlamp_idr);                  // Numeração das lâmpadas (lampN): índice -> struct smartlamp
+static DEFINE_MUTEX(smartlamp_idr_lock);           // Protege smartlamp_idr (probe, disconnect e open)
+static dev_t smartlamp_devt;                       // Primeiro número de /dev/smartlampN
+static struct workqueue_struct *smartlamp_wq;      // Executa a amostragem em segundo plano de todas as lâmpadas
+static struct dentry *smartlamp_debugfs_root;      // /sys/kernel/debug/smartlamp
 
-MODULE_DEVICE_TABLE(usb, id_table);
+static bool smartlamp_tagged = true;               // Tenta negociar o modo com etiquetas ao conectar
+module_param_named(tagged, smartlamp_tagged, bool, 0444);
+MODULE_PARM_DESC(tagged, "Envia comandos com etiquetas (#<seq>) e mantém vários em andamento, se o firmware suportar");
+
+static bool smartlamp_binary = true;               // Tenta negociar o protocolo binário ao conectar
+module_param_named(binary, smartlamp_binary, bool, 0444);
+MODULE_PARM_DESC(binary, "Usa quadros binários (COBS + CRC-16) em vez de texto, se o firmware suportar");
+
+static unsigned int smartlamp_baud = 921600;       // Velocidade negociada com o firmware depois do SMARTLAMP_HELLO
+module_param_named(baud, smartlamp_baud, uint, 0444);
+MODULE_PARM_DESC(baud, "Velocidade da linha serial negociada com o firmware (9600 mantém a velocidade inicial)");
+
+// Nome do arquivo de dispositivo de lampN: /dev/smartlampN
+static char *smartlamp_devnode(const struct device *dev, umode_t *mode) {
+    return kasprintf(GFP_KERNEL, "smartlamp%u", MINOR(dev->devt));
+}
 
-bool ignore = true;
-int LDR_value = 0;
+// Classe /sys/class/smartlamp: um diretório lampN por SmartLamp conectado
+static struct class smartlamp_class = {
+    .name       = "smartlamp",
+    .dev_groups = smartlamp_groups,
+    .devnode    = smartlamp_devnode,
+};
+
+static int smartlamp_open(struct inode *inode, struct file *file);
+static int smartlamp_release(struct inode *inode, struct file *file);
+static ssize_t smartlamp_read(struct file *file, char __user *buf, size_t count, loff_t *ppos);
+static __poll_t smartlamp_poll(struct file *file, poll_table *wait);
+static int smartlamp_mmap(struct file *file, struct vm_area_struct *vma);
+static int smartlamp_fsync(struct file *file, loff_t start, loff_t end, int datasync);
+
+// Operações de /dev/smartlampN
+static const struct file_operations smartlamp_fops = {
+    .owner   = THIS_MODULE,
+    .open    = smartlamp_open,
+    .release = smartlamp_release,
+    .read    = smartlamp_read,
+    .poll    = smartlamp_poll,
+    .mmap    = smartlamp_mmap,
+    .fsync   = smartlamp_fsync,
+};
 
 static struct usb_driver smartlamp_driver = {
     .name        = "smartlamp",     // Nome do driver
     .probe       = usb_probe,       // Executado quando o dispositivo é conectado na USB
     .disconnect  = usb_disconnect,  // Executado quando o dispositivo é desconectado na USB
     .id_table    = id_table,        // Tabela com o VendorID e ProductID do dispositivo
+    .dev_groups  = smartlamp_groups, // Arquivos criados no diretório da interface USB
 };
 
-module_usb_driver(smartlamp_driver);
+static int __init smartlamp_init(void) {
+    int ret;
+
+    // Cada lâmpada pode ficar bloqueada esperando o dispositivo: usa uma fila própria, não a do sistema
+    smartlamp_wq = alloc_workqueue("smartlamp", WQ_UNBOUND, 0);
+    if (!smartlamp_wq)
+        return -ENOMEM;
+
+    ret = alloc_chrdev_region(&smartlamp_devt, 0, SMARTLAMP_MAX_DEVICES, "smartlamp");
+    if (ret)
+        goto err_wq;
+
+    ret = class_register(&smartlamp_class);
+    if (ret)
+        goto err_chrdev;
+
+    smartlamp_debugfs_root = debugfs_create_dir("smartlamp", NULL);
+
+    ret = usb_register(&smartlamp_driver);
+    if (ret)
+        goto err_debugfs;
+
+    return 0;
+
+err_debugfs:
+    debugfs_remove_recursive(smartlamp_debugfs_root);
+    class_unregister(&smartlamp_class);
+err_chrdev:
+    unregister_chrdev_region(smartlamp_devt, SMARTLAMP_MAX_DEVICES);
+err_wq:
+    destroy_workqueue(smartlamp_wq);
+    return ret;
+}
+
+static void __exit smartlamp_exit(void) {
+    usb_deregister(&smartlamp_driver);
+    debugfs_remove_recursive(smartlamp_debugfs_root);
+    class_unregister(&smartlamp_class);
+    unregister_chrdev_region(smartlamp_devt, SMARTLAMP_MAX_DEVICES);
+    destroy_workqueue(smartlamp_wq);
+    idr_destroy(&smartlamp_idr);
+}
+
+module_init(smartlamp_init);
+module_exit(smartlamp_exit);
+
+// Libera as URBs e os buffers alocados no probe
+static void usb_free_urbs(struct smartlamp *sl) {
+    int i;
+
+    for (i = 0; i < SMARTLAMP_IN_URBS; ++i) {
+        if (!sl->in_urbs[i])
+            continue;
+        usb_free_coherent(sl->udev, sl->usb_in_size,
+                          sl->in_urbs[i]->transfer_buffer, sl->in_urbs[i]->transfer_dma);
+        usb_free_urb(sl->in_urbs[i]);
+        sl->in_urbs[i] = NULL;
+    }
+    usb_free_urb(sl->out_urb);
+    sl->out_urb = NULL;
+    kfree(sl->usb_out_buffer);
+    sl->usb_out_buffer = NULL;
+}
+
+// Aloca as URBs de leitura (com buffers DMA) e a URB de envio
+static int usb_alloc_urbs(struct smartlamp *sl) {
+    char *buf;
+    int i;
+
+    for (i = 0; i < SMARTLAMP_IN_URBS; ++i) {
+        sl->in_urbs[i] = usb_alloc_urb(0, GFP_KERNEL);
+        if (!sl->in_urbs[i])
+            return -ENOMEM;
+
+        buf = usb_alloc_coherent(sl->udev, sl->usb_in_size, GFP_KERNEL,
+                                 &sl->in_urbs[i]->transfer_dma);
+        if (!buf) {
+            usb_free_urb(sl->in_urbs[i]);
+            sl->in_urbs[i] = NULL;
+            return -ENOMEM;
+        }
+
+        usb_fill_bulk_urb(sl->in_urbs[i], sl->udev,
+                          usb_rcvbulkpipe(sl->udev, sl->usb_in),
+                          buf, sl->usb_in_size, usb_read_callback, sl);
+        sl->in_urbs[i]->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+    }
+
+    sl->out_urb = usb_alloc_urb(0, GFP_KERNEL);
+    sl->usb_out_buffer = kmalloc(sl->usb_max_size, GFP_KERNEL);
+    if (!sl->out_urb || !sl->usb_out_buffer)
+        return -ENOMEM;
+
+    return 0;
+}
+
+// Submete todas as URBs de leitura: a partir daqui, todo byte enviado pelo dispositivo é recebido
+static int usb_start_reading(struct smartlamp *sl) {
+    int i, ret;
+
+    for (i = 0; i < SMARTLAMP_IN_URBS; ++i) {
+        usb_anchor_urb(sl->in_urbs[i], &sl->in_anchor);
+        ret = usb_submit_urb(sl->in_urbs[i], GFP_KERNEL);
+        if (ret) {
+            usb_unanchor_urb(sl->in_urbs[i]);
+            usb_kill_anchored_urbs(&sl->in_anchor);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+// Executado quando a última referência ao SmartLamp é devolvida
+static void smartlamp_delete(struct kref *kref) {
+    struct smartlamp *sl = container_of(kref, struct smartlamp, kref);
+
+    usb_free_urbs(sl);
+    vfree(sl->ring);
+    usb_put_intf(sl->interface);
+    usb_put_dev(sl->udev);
+    kfree(sl);
+}
+
+// Programa a linha serial da ponte: baud, 8 bits, sem paridade, 1 bit de parada e sem controle de fluxo.
+// DTR e RTS não são tocados: nas placas ESP32 eles ligam EN e IO0 e reiniciariam o firmware
+static int smartlamp_set_line(struct smartlamp *sl, unsigned int baud) {
+    int ret;
+
+    ret = sl->ops->set_line(sl, baud);
+    if (ret)
+        return ret;
+
+    WRITE_ONCE(sl->baud, baud);
+    dev_info(&sl->interface->dev, "Linha serial (%s): %u baud, 8N1.\n", sl->ops->name, baud);
+    return 0;
+}
+
+// /sys/kernel/debug/smartlamp/lampN/latency_hist: quantidade de comandos por faixa de tempo de resposta
+static int smartlamp_hist_show(struct seq_file *m, void *unused) {
+    struct smartlamp *sl = m->private;
+    u64 hist[SMARTLAMP_HIST_BUCKETS];
+    unsigned long flags;
+    int i, last = -1;
+
+    spin_lock_irqsave(&sl->rtt_lock, flags);
+    memcpy(hist, sl->rtt_hist, sizeof(hist));
+    spin_unlock_irqrestore(&sl->rtt_lock, flags);
+
+    for (i = 0; i < SMARTLAMP_HIST_BUCKETS; ++i) {
+        if (hist[i])
+            last = i;
+    }
+
+    seq_puts(m, "        us : count\n");
+    for (i = 0; i <= last; ++i) {
+        if (i == SMARTLAMP_HIST_BUCKETS - 1)
+            seq_printf(m, "%8lu+  : %llu\n", 1UL << i, hist[i]);
+        else
+            seq_printf(m, "%8lu -> %lu : %llu\n", i ? 1UL << i : 0, (1UL << (i + 1)) - 1, hist[i]);
+    }
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(smartlamp_hist);
+
+// /sys/kernel/debug/smartlamp/lampN/commands: contadores de cada comando enviado
+static int smartlamp_cmds_show(struct seq_file *m, void *unused) {
+    struct smartlamp *sl = m->private;
+    struct smartlamp_cmd_stats *stats;
+    unsigned long flags;
+    int i;
+
+    stats = kmalloc_array(SMARTLAMP_CMD_STATS, sizeof(*stats), GFP_KERNEL);
+    if (!stats)
+        return -ENOMEM;
+
+    spin_lock_irqsave(&sl->rtt_lock, flags);
+    memcpy(stats, sl->cmd_stats, SMARTLAMP_CMD_STATS * sizeof(*stats));
+    spin_unlock_irqrestore(&sl->rtt_lock, flags);
+
+    seq_printf(m, "%-20s %10s %10s %10s %10s %10s %10s\n",
+               "cmd", "sent", "ok", "errors", "timeouts", "retries", "shared");
+    for (i = 0; i < SMARTLAMP_CMD_STATS && stats[i].cmd[0]; ++i)
+        seq_printf(m, "%-20s %10llu %10llu %10llu %10llu %10llu %10llu\n", stats[i].cmd, stats[i].sent,
+                   stats[i].ok, stats[i].errors, stats[i].timeouts, stats[i].retries, stats[i].shared);
 
-// Executado quando o dispositivo é conectado na USB
+    kfree(stats);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(smartlamp_cmds);
+
+// Probe de esp pessoal
 static int usb_probe(struct usb_interface *interface, const struct usb_device_id *id) {
-    struct usb_endpoint_descriptor *usb_endpoint_in, *usb_endpoint_out;
+    struct usb_host_interface *iface_desc;
+    struct usb_endpoint_descriptor *endpoint;
+    const struct smartlamp_bridge_ops *ops = (const struct smartlamp_bridge_ops *)id->driver_info;
+    struct smartlamp *sl;
+    unsigned long flags;
+    int i, ret;
+
+    dev_info(&interface->dev, "Dispositivo conectado (%s) ...\n", ops->name);
+
+    if (!interface->cur_altsetting) {
+        dev_err(&interface->dev, "Interface ou altsetting inválidos\n");
+        return -ENODEV;
+    }
+
+    iface_desc = interface->cur_altsetting;
+
+    // Verifica se é a interface esperada
+    if (iface_desc->desc.bInterfaceNumber != ops->interface) {
+        dev_info(&interface->dev, "Ignorando interface %d (esperado: %d).\n",
+                 iface_desc->desc.bInterfaceNumber, ops->interface);
+        return -ENODEV;
+    }
+
+    sl = kzalloc(sizeof(*sl), GFP_KERNEL);
+    if (!sl)
+        return -ENOMEM;
+
+    kref_init(&sl->kref);
+    init_rwsem(&sl->cmd_sem);
+    mutex_init(&sl->out_lock);
+    INIT_LIST_HEAD(&sl->pending_cmds);
+    spin_lock_init(&sl->resp_lock);
+    spin_lock_init(&sl->flight_lock);
+    INIT_LIST_HEAD(&sl->flights);
+    spin_lock_init(&sl->rtt_lock);
+    spin_lock_init(&sl->cache_lock);
+    INIT_DELAYED_WORK(&sl->sample_work, smartlamp_sample_work);
+    mutex_init(&sl->led_lock);
+    mutex_init(&sl->stream_lock);
+    sl->ldr_filter = SMARTLAMP_LDR_FILTER_AVG;
+    sl->ldr_window = SMARTLAMP_LDR_WINDOW_DEFAULT;
+    INIT_WORK(&sl->led_sync_work, smartlamp_led_sync_work);
+    spin_lock_init(&sl->led_req_lock);
+    INIT_WORK(&sl->led_work, smartlamp_led_work);
+    INIT_WORK(&sl->halt_work, smartlamp_halt_work);
+    init_waitqueue_head(&sl->led_wait);
+    sl->led_req = -1;
+    spin_lock_init(&sl->readers_lock);
+    INIT_LIST_HEAD(&sl->readers);
+    init_waitqueue_head(&sl->read_wait);
+    for (i = 0; i < SMARTLAMP_NCHANNELS; ++i)
+        sl->interval_ms[i] = smartlamp_channels[i].interval_ms;
+    init_usb_anchor(&sl->in_anchor);
+    init_completion(&sl->out_done);
+    smartlamp_framer_reset(&sl->framer);
+
+    sl->index = -1;
+    sl->ops = ops;
+    sl->udev = usb_get_dev(interface_to_usbdev(interface));
+    sl->interface = usb_get_intf(interface);
+
+    dev_info(&interface->dev, "Número de endpoints: %d\n", iface_desc->desc.bNumEndpoints);
+
+    // Busca endpoints bulk IN e OUT
+    for (i = 0; i < iface_desc->desc.bNumEndpoints; ++i) {
+        endpoint = &iface_desc->endpoint[i].desc;
+        dev_info(&interface->dev, "Endpoint[%d]: addr=0x%02x, attr=0x%02x\n",
+                 i, endpoint->bEndpointAddress, endpoint->bmAttributes);
+
+        if ((endpoint->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK) == USB_ENDPOINT_XFER_BULK) {
+            if (endpoint->bEndpointAddress & USB_DIR_IN) {
+                sl->usb_in = endpoint->bEndpointAddress;
+                sl->usb_max_size = usb_endpoint_maxp(endpoint); // Tamanho máximo do pacote do endpoint IN
+            } else {
+                sl->usb_out = endpoint->bEndpointAddress;
+            }
+        }
+    }
+
+    if (!sl->usb_in || !sl->usb_out) {
+        dev_err(&interface->dev, "Endpoints Bulk IN/OUT não encontrados. Dispositivo não suportado.\n");
+        ret = -ENODEV;
+        goto err_put;
+    }
+
+    if (!sl->usb_max_size) {
+        dev_err(&interface->dev, "Falha ao obter tamanho do pacote do endpoint IN.\n");
+        ret = -ENODEV;
+        goto err_put;
+    }
+
+    sl->usb_in_size = roundup(max_t(unsigned int, ops->rx_size, sl->usb_max_size), sl->usb_max_size);
+
+    ret = usb_alloc_urbs(sl);
+    if (ret) {
+        dev_err(&interface->dev, "Falha na alocação de URBs e buffers.\n");
+        goto err_put;
+    }
+
+    dev_info(&interface->dev, "Endpoint IN: 0x%02x, OUT: 0x%02x, tamanho: %d (leitura: %d)\n",
+             sl->usb_in, sl->usb_out, sl->usb_max_size, sl->usb_in_size);
 
-    printk(KERN_INFO "SmartLamp: Dispositivo conectado ...\n");
+    if (ops->init) {
+        ret = ops->init(sl);
+        if (ret) {
+            dev_err(&interface->dev, "Falha ao iniciar a ponte %s, codigo %d\n", ops->name, ret);
+            goto err_put;
+        }
+    }
+
+    // A ponte começa na velocidade do firmware recém-iniciado; a negociação em led_sync_work a aumenta
+    ret = smartlamp_set_line(sl, SMARTLAMP_BAUD_BOOT);
+    if (ret) {
+        dev_err(&interface->dev, "Falha ao configurar a linha serial, codigo %d\n", ret);
+        goto err_put;
+    }
+
+    // Anel mapeável com mmap(). vmalloc_user já entrega as páginas zeradas
+    sl->ring = vmalloc_user((1 + SMARTLAMP_RING_PAGES) * PAGE_SIZE);
+    if (!sl->ring) {
+        ret = -ENOMEM;
+        goto err_put;
+    }
+    sl->ring_page = sl->ring;
+    sl->ring_data = sl->ring + PAGE_SIZE;
+    sl->ring_page->data_offset = PAGE_SIZE;
+    sl->ring_page->data_size = SMARTLAMP_RING_PAGES * PAGE_SIZE;
+    sl->ring_page->data_capacity = SMARTLAMP_RING_RECORDS;
+
+    usb_set_intfdata(interface, sl);
+
+    ret = usb_start_reading(sl);
+    if (ret) {
+        dev_err(&interface->dev, "Falha ao submeter URBs de leitura, codigo %d\n", ret);
+        goto err_put;
+    }
+
+    mutex_lock(&smartlamp_idr_lock);
+    ret = idr_alloc(&smartlamp_idr, sl, 0, SMARTLAMP_MAX_DEVICES, GFP_KERNEL);
+    mutex_unlock(&smartlamp_idr_lock);
+    if (ret < 0)
+        goto err_kill;
+    sl->index = ret;
+
+    // O cdev é alocado à parte: arquivos ainda abertos podem mantê-lo vivo depois da desconexão
+    sl->cdev = cdev_alloc();
+    if (!sl->cdev) {
+        ret = -ENOMEM;
+        goto err_idr;
+    }
+    sl->cdev->owner = THIS_MODULE;
+    sl->cdev->ops = &smartlamp_fops;
+    ret = cdev_add(sl->cdev, MKDEV(MAJOR(smartlamp_devt), sl->index), 1);
+    if (ret) {
+        kobject_put(&sl->cdev->kobj);
+        goto err_idr;
+    }
+
+    // Cria /sys/class/smartlamp/lampN e /dev/smartlampN somente quando o dispositivo já pode responder
+    sl->dev = device_create(&smartlamp_class, &interface->dev, MKDEV(MAJOR(smartlamp_devt), sl->index),
+                            sl, "lamp%d", sl->index);
+    if (IS_ERR(sl->dev)) {
+        ret = PTR_ERR(sl->dev);
+        goto err_cdev;
+    }
+
+    // Estatísticas para depuração; falhas no debugfs não impedem o uso do dispositivo
+    sl->debugfs = debugfs_create_dir(dev_name(sl->dev), smartlamp_debugfs_root);
+    debugfs_create_file("latency_hist", 0444, sl->debugfs, sl, &smartlamp_hist_fops);
+    debugfs_create_file("commands", 0444, sl->debugfs, sl, &smartlamp_cmds_fops);
 
-    // Cria arquivos do /sys/kernel/smartlamp/*
-    sys_obj = kobject_create_and_add("smartlamp", kernel_kobj);
-    ignore = sysfs_create_group(sys_obj, &attr_group); // AQUI
+    // LED na classe de LEDs do kernel, para que gatilhos (timer, heartbeat, netdev, ...) controlem a lâmpada.
+    // Como o link antigo abaixo, uma falha aqui não impede o uso do dispositivo pelos outros arquivos
+    snprintf(sl->led_name, sizeof(sl->led_name), "smartlamp%d:white:lamp", sl->index);
+    sl->led_cdev.name = sl->led_name;
+    sl->led_cdev.max_brightness = SMARTLAMP_LED_MAX;
+    sl->led_cdev.brightness_set = smartlamp_led_cdev_set;
+    sl->led_cdev.brightness_get = smartlamp_led_cdev_get;
+    sl->led_cdev.flags = LED_RETAIN_AT_SHUTDOWN;   // rmmod não apaga a lâmpada
+    if (led_classdev_register(sl->dev, &sl->led_cdev))
+        dev_warn(&interface->dev, "Falha ao registrar %s na classe de LEDs\n", sl->led_name);
 
-    // Detecta portas e aloca buffers de entrada e saída de dados na USB
-    smartlamp_device = interface_to_usbdev(interface);
-    ignore =  usb_find_common_endpoints(interface->cur_altsetting, &usb_endpoint_in, &usb_endpoint_out, NULL, NULL);  // AQUI
-    usb_max_size = usb_endpoint_maxp(usb_endpoint_in);
-    usb_in = usb_endpoint_in->bEndpointAddress;
-    usb_out = usb_endpoint_out->bEndpointAddress;
-    usb_in_buffer = kmalloc(usb_max_size, GFP_KERNEL);
-    usb_out_buffer = kmalloc(usb_max_size, GFP_KERNEL);
-    // Verificar se aqui mudar mesmo
-    // LDR_value = usb_read_serial();
-    LDR_value = usb_send_cmd("GET_LDR", -1);
+    // Sensores no IIO (iio_readdev, libiio, ...). Também opcional
+    ret = smartlamp_iio_register(sl);
+    if (ret)
+        dev_warn(&interface->dev, "Falha ao registrar os sensores no IIO, codigo %d\n", ret);
 
-    printk("LDR Value: %d\n", LDR_value);
+    // Mantém o caminho antigo /sys/kernel/smartlamp apontando para a primeira lâmpada
+    if (sl->index == 0 && sysfs_create_link(kernel_kobj, &sl->dev->kobj, "smartlamp"))
+        dev_warn(&interface->dev, "Falha ao criar /sys/kernel/smartlamp\n");
 
+    // Descobre a intensidade atual do LED e começa a amostrar os sensores
+    queue_work(smartlamp_wq, &sl->led_sync_work);
+    queue_delayed_work(smartlamp_wq, &sl->sample_work, 0);
+
+    dev_info(&interface->dev, "SmartLamp conectado como lamp%d\n", sl->index);
     return 0;
+
+err_cdev:
+    cdev_del(sl->cdev);
+err_idr:
+    mutex_lock(&smartlamp_idr_lock);
+    idr_remove(&smartlamp_idr, sl->index);
+    mutex_unlock(&smartlamp_idr_lock);
+err_kill:
+    spin_lock_irqsave(&sl->resp_lock, flags);
+    sl->disconnected = true;                // Nenhum work novo a partir das leituras
+    spin_unlock_irqrestore(&sl->resp_lock, flags);
+    cancel_work_sync(&sl->halt_work);
+    usb_kill_anchored_urbs(&sl->in_anchor);
+    cancel_work_sync(&sl->led_sync_work);
+err_put:
+    usb_set_intfdata(interface, NULL);
+    kref_put(&sl->kref, smartlamp_delete);
+    return ret;
 }
 
 // Executado quando o dispositivo USB é desconectado da USB
 static void usb_disconnect(struct usb_interface *interface) {
-    printk(KERN_INFO "SmartLamp: Dispositivo desconectado.\n");
-    if (sys_obj) kobject_put(sys_obj);      // Remove os arquivos em /sys/kernel/smartlamp
-    kfree(usb_in_buffer);                   // Desaloca buffers
-    kfree(usb_out_buffer);
-}
-
-// Envia um comando via USB, espera e retorna a resposta do dispositivo (convertido para int)
-// Exemplo de Comando:  SET_LED 80
-// Exemplo de Resposta: RES SET_LED 1
-// Exemplo de chamada da função usb_send_cmd para SET_LED: usb_send_cmd("SET_LED", 80);
-static int usb_send_cmd(char *cmd, int param) {
-    int ret, actual_size;
-    int retries = 5;
-    char resp_expected[MAX_RECV_LINE];
-    int value;
+    struct smartlamp *sl = usb_get_intfdata(interface);
+    struct smartlamp_cmd *c, *tmp;
+    unsigned long flags;
 
-    printk(KERN_INFO "SmartLamp: Enviando comando: %s\n", cmd);
+    dev_info(&interface->dev, "Dispositivo desconectado.\n");
 
-    if (param == -1) {
-        snprintf(usb_out_buffer, usb_max_size, "%s\n", cmd);
-    } else {
-        snprintf(usb_out_buffer, usb_max_size, "%s %d\n", cmd, param);
+    debugfs_remove_recursive(sl->debugfs); // Espera as leituras em andamento terminarem
+    led_classdev_unregister(&sl->led_cdev); // Desliga o gatilho: nenhum pedido novo depois daqui
+    smartlamp_iio_unregister(sl);           // Desliga o buffer e espera as leituras em andamento
+
+    if (sl->index == 0)
+        sysfs_remove_link(kernel_kobj, "smartlamp");
+    device_unregister(sl->dev);             // Remove /sys/class/smartlamp/lampN e /dev/smartlampN
+    cdev_del(sl->cdev);
+
+    mutex_lock(&smartlamp_idr_lock);        // Novos open() não encontram mais o dispositivo
+    idr_remove(&smartlamp_idr, sl->index);
+    mutex_unlock(&smartlamp_idr_lock);
+
+    // Novos comandos falham e os que aguardam resposta acordam imediatamente. Daqui em diante nada mais
+    // enfileira led_sync_work
+    spin_lock_irqsave(&sl->resp_lock, flags);
+    sl->disconnected = true;
+    list_for_each_entry_safe(c, tmp, &sl->pending_cmds, node) {
+        c->status = -ENODEV;
+        list_del_init(&c->node);
+        complete(&c->done);
     }
+    spin_unlock_irqrestore(&sl->resp_lock, flags);
 
-    printk(KERN_INFO "SmartLamp: Comando enviado %s !\n", usb_out_buffer);
+    // Cancela as leituras pendentes antes dos works: uma linha recebida (e.g., SMARTLAMP_HELLO) não pode
+    // enfileirar um work depois de cancelado. halt_work vem antes, porque ele mesmo submete as leituras
+    cancel_work_sync(&sl->halt_work);
+    usb_kill_anchored_urbs(&sl->in_anchor);
 
-    ret = usb_bulk_msg(smartlamp_device,
-                       usb_sndbulkpipe(smartlamp_device, usb_out),
-                       usb_out_buffer,
-                       min(usb_max_size, MAX_RECV_LINE),
-                       &actual_size,
-                       1000);
-    if (ret) {
-        printk(KERN_ERR "SmartLamp: Erro ao enviar comando, codigo %d!\n", ret);
-        return -1;
+    cancel_delayed_work_sync(&sl->sample_work);
+    cancel_work_sync(&sl->led_sync_work);
+    cancel_work_sync(&sl->led_work);
+
+    down_write(&sl->cmd_sem);               // Espera os comandos em andamento (se houver) terminarem
+    up_write(&sl->cmd_sem);
+    wake_up_interruptible_all(&sl->read_wait); // Leitores bloqueados recebem fim de arquivo
+    wake_up_all(&sl->led_wait);             // fsync() de pedidos de LED não enviados falha
+
+    usb_kill_urb(sl->out_urb);
+    usb_set_intfdata(interface, NULL);
+
+    kref_put(&sl->kref, smartlamp_delete);  // Desaloca URBs e buffers quando ninguém mais usa o dispositivo
+}
+
+// Enfileira um work do dispositivo (led_sync_work, halt_work), exceto depois da desconexão. Testar
+// disconnected sob resp_lock garante que todo enfileiramento aconteça antes do cancel_work_sync() de usb_disconnect
+static void smartlamp_queue(struct smartlamp *sl, struct work_struct *work) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&sl->resp_lock, flags);
+    if (!sl->disconnected)
+        queue_work(smartlamp_wq, work);
+    spin_unlock_irqrestore(&sl->resp_lock, flags);
+}
+
+// Descarta a linha parcialmente montada
+static void smartlamp_framer_reset(struct smartlamp_framer *fr) {
+    fr->len = 0;
+    fr->discard = false;
+}
+
+// Modo binário: acumula um quadro até o delimitador 0 e chama emit_frame(). Um firmware que reiniciou
+// volta ao modo texto e envia SMARTLAMP_HELLO: a linha é reconhecida mesmo no meio de um quadro
+static void smartlamp_framer_feed_binary(struct smartlamp_framer *fr, char c,
+                                         void (*emit)(void *ctx, const char *line),
+                                         void (*emit_frame)(void *ctx, const u8 *frame, int len), void *ctx) {
+    if (fr->hello_pos == sizeof(SMARTLAMP_HELLO) - 1 && c == '\n') {
+        fr->binary = false;
+        fr->hello_pos = 0;
+        smartlamp_framer_reset(fr);
+        emit(ctx, SMARTLAMP_HELLO);
+        return;
+    }
+    // Com SMARTLAMP_HELLO inteiro reconhecido, só '\n' completa a linha: não compara com o '\0' do fim
+    if (fr->hello_pos < sizeof(SMARTLAMP_HELLO) - 1 && c == SMARTLAMP_HELLO[fr->hello_pos])
+        fr->hello_pos++;
+    else
+        fr->hello_pos = (c == SMARTLAMP_HELLO[0]);
+
+    if (c == 0) {
+        if (fr->discard)
+            fr->dropped++;
+        else if (fr->len > 0)
+            emit_frame(ctx, (const u8 *)fr->recv_line, fr->len);
+        smartlamp_framer_reset(fr);
+        return;
     }
 
-    printk(KERN_INFO "SmartLamp: Comando enviado com sucesso!\n");
+    if (fr->discard)
+        return;
 
-    // Prefixo esperado com espaço para facilitar o parsing
-    sprintf(resp_expected, "S %s ", cmd);
+    if (fr->len >= MAX_RECV_LINE) {
+        fr->discard = true;
+        return;
+    }
 
-    while (retries > 0) {
-        ret = usb_bulk_msg(smartlamp_device,
-                           usb_rcvbulkpipe(smartlamp_device, usb_in),
-                           usb_in_buffer,
-                           min(usb_max_size, MAX_RECV_LINE),
-                           &actual_size,
-                           1000);
+    fr->recv_line[fr->len++] = c;
+}
 
-        if (ret) {
-            printk(KERN_ERR "SmartLamp: Erro ao ler dados da USB (tentativa %d), codigo %d\n", retries, ret);
-            retries--;
-            ssleep(2);
+// Acumula os bytes recebidos e chama emit() para cada linha completa (sem '\r' e '\n').
+// Linhas maiores que MAX_RECV_LINE ou com caracteres não imprimíveis são descartadas inteiras.
+// Percorre cada byte uma única vez, independente de como os dados foram divididos em pacotes.
+static void smartlamp_framer_feed(struct smartlamp_framer *fr, const char *data, int len,
+                                  void (*emit)(void *ctx, const char *line),
+                                  void (*emit_frame)(void *ctx, const u8 *frame, int len), void *ctx) {
+    const char *end = data + len;
+    char c;
+
+    for (; data < end; ++data) {
+        c = *data;
+
+        // O modo pode mudar no meio do pacote (emit trata "RES BINARY 1"): vale a partir do próximo byte
+        if (fr->binary) {
+            smartlamp_framer_feed_binary(fr, c, emit, emit_frame, ctx);
             continue;
         }
 
-        if (actual_size > 0) {
-            usb_in_buffer[actual_size] = '\0';  // termina string
-            printk(KERN_INFO "SmartLamp: Dados recebidos:\n%s\n", usb_in_buffer);
-
-            // Busca o prefixo na string recebida
-            char *pos = strstr(usb_in_buffer, resp_expected);
-            if (pos) {
-                // Pula o prefixo para o começo do número
-                pos += strlen(resp_expected);
-                // Tenta ler o número
-                if (sscanf(pos, "%d", &value) == 1) {
-                    printk(KERN_INFO "SmartLamp: Valor extraído: %d\n", value);
-                    return value;
-                } else {
-                    printk(KERN_ERR "SmartLamp: Prefixo encontrado, mas falha ao extrair valor.\n");
-                }
-            } else {
-                printk(KERN_ERR "SmartLamp: Prefixo '%s' não encontrado na mensagem.\n", resp_expected);
+        if (c == '\n') {
+            if (fr->discard)
+                fr->dropped++;
+            else if (fr->len > 0) {
+                fr->recv_line[fr->len] = '\0';
+                emit(ctx, fr->recv_line);
             }
+            smartlamp_framer_reset(fr);
+            continue;
         }
 
-        retries--;
-        ssleep(2);
+        if (fr->discard || c == '\r')
+            continue;
+
+        if (c < ' ' || c > '~' || fr->len >= MAX_RECV_LINE - 1) {
+            fr->discard = true;
+            continue;
+        }
+
+        fr->recv_line[fr->len++] = c;
     }
+}
 
-    printk(KERN_ERR "SmartLamp: Falha ao obter resposta válida após múltiplas tentativas.\n");
-    return -1;
+static void smartlamp_publish(struct smartlamp *sl, enum smartlamp_channel ch, int value, ktime_t stamp);
+static void smartlamp_publish_read(struct smartlamp *sl, enum smartlamp_channel ch, int value, ktime_t stamp);
+static void smartlamp_publish_all(struct smartlamp *sl, const int *values, ktime_t now, int age_ms);
+
+// Converte um número em texto para ponto fixo com a quantidade de casas decimais do canal:
+// "23.4" com decimals = 1 vira 234 e "23" vira 230. Retorna o fim do número ou NULL se o texto
+// não começa com um número
+static const char *smartlamp_parse_value(const char *s, unsigned int decimals, int *value) {
+    bool neg = false;
+    unsigned int i;
+    int v = 0;
+
+    if (*s == '-') {
+        neg = true;
+        s++;
+    }
+    if (!isdigit(*s))
+        return NULL;
+
+    while (isdigit(*s))
+        v = v * 10 + (*s++ - '0');
+
+    if (*s == '.')
+        s++;
+    for (i = 0; i < decimals; ++i) {
+        v *= 10;
+        if (isdigit(*s))
+            v += *s++ - '0';
+    }
+
+    *value = neg ? -v : v;
+    return s;
 }
 
+// Momento em que o valor de um canal foi lido: os canais que o firmware responde do cache (DHT) trazem a
+// idade da leitura, e o cache do driver (max_age_ms) e os registros de /dev/smartlampN usam o instante real
+static ktime_t smartlamp_sample_stamp(enum smartlamp_channel ch, ktime_t now, int age_ms) {
+    if (!smartlamp_channels[ch].aged || age_ms <= 0)
+        return now;
+    return ktime_sub_ns(now, (u64)age_ms * NSEC_PER_MSEC);
+}
 
-// Executado quando o arquivo /sys/kernel/smartlamp/{led, ldr} é lido (e.g., cat /sys/kernel/smartlamp/led)
-static ssize_t attr_show(struct kobject *sys_obj, struct kobj_attribute *attr, char *buff) {
-    // value representa o valor do led ou ldr
-    int value;
-    // attr_name representa o nome do arquivo que está sendo lido (ldr ou led)
-    const char *attr_name = attr->attr.name;
+// Converte a idade opcional que segue um valor (" 850": o firmware leu o sensor há 850 ms). 0 se ausente
+static int smartlamp_parse_age(const char *s) {
+    int age;
 
-    // printk indicando qual arquivo está sendo lido
-    printk(KERN_INFO "SmartLamp: Lendo %s ...\n", attr_name);
-
-    // Implemente a leitura do valor do led ou ldr usando a função usb_send_cmd()
-    if (strcmp(attr_name, "ldr") == 0)
-        value = usb_send_cmd("GET_LDR", -1);
-    else if (strcmp(attr_name, "led") == 0)
-        value = usb_send_cmd("GET_LED", -1);
-    else if (strcmp(attr_name, "temp") == 0)
-        value = usb_send_cmd("GET_TEMP", -1);
-    else if (strcmp(attr_name, "hum") == 0)
-        value = usb_send_cmd("GET_HUM", -1);
-    else
-        return -EINVAL;
+    if (!s || *s != ' ' || !smartlamp_parse_value(s + 1, 0, &age))
+        return 0;
+    return max(age, 0);
+}
 
-    sprintf(buff, "%d\n", value);                 // Cria a mensagem com o valor do led, ldr
-    return strlen(buff);
+// Converte a resposta de GET_ALL ("50 42 23.4 61.0 850", um valor por canal, "nan" se o sensor falhou,
+// e a idade da leitura do DHT). age_ms pode ser NULL
+static bool smartlamp_parse_all(const char *s, int *values, int *age_ms) {
+    int ch;
+
+    for (ch = 0; ch < SMARTLAMP_NCHANNELS; ++ch) {
+        s = skip_spaces(s);
+        if (strncmp(s, "nan", 3) == 0) {
+            values[ch] = SMARTLAMP_VALUE_NAN;
+            s += 3;
+            continue;
+        }
+        s = smartlamp_parse_value(s, smartlamp_channels[ch].decimals, &values[ch]);
+        if (!s)
+            return false;
+    }
+
+    if (age_ms)
+        *age_ms = smartlamp_parse_age(s);
+    return true;
 }
 
+// Se a linha é a leitura de um canal ("RES GET_LDR 42" ou "RES GET_TEMP 23.4 850"), retorna o canal, o
+// valor em *value e a idade da leitura (0 se ausente) em *age_ms; senão, -1
+static int smartlamp_parse_sample(const char *line, int *value, int *age_ms) {
+    const char *cmd, *end;
+    int ch, len;
 
-// Essa função não deve ser alterada durante a task sysfs
-// Executado quando o arquivo /sys/kernel/smartlamp/{led, ldr} é escrito (e.g., echo "100" | sudo tee -a /sys/kernel/smartlamp/led)
-static ssize_t attr_store(struct kobject *sys_obj, struct kobj_attribute *attr, const char *buff, size_t count) {
-    long ret, value;
-    const char *attr_name = attr->attr.name;
+    if (strncmp(line, "RES ", 4) != 0)
+        return -1;
+    line += 4;
 
-    // Converte o valor recebido para long
-    ret = kstrtol(buff, 10, &value);
-    if (ret) {
-        printk(KERN_ALERT "SmartLamp: valor de %s invalido.\n", attr_name);
-        return -EACCES;
+    for (ch = 0; ch < SMARTLAMP_NCHANNELS; ++ch) {
+        cmd = smartlamp_channels[ch].cmd;
+        len = strlen(cmd);
+        if (strncmp(line, cmd, len) != 0 || line[len] != ' ')
+            continue;
+        end = smartlamp_parse_value(line + len + 1, smartlamp_channels[ch].decimals, value);
+        if (!end)
+            continue;
+        *age_ms = smartlamp_parse_age(end);
+        return ch;
     }
 
-    printk(KERN_INFO "SmartLamp: Setando %s para %ld ...\n", attr_name, value);
+    return -1;
+}
 
-    // utilize a função usb_send_cmd para enviar o comando SET_LED X
-    if (strcmp(attr_name, "led") == 0)
-        ret = usb_send_cmd("SET_LED", value);
+// Verifica se a linha (já sem etiqueta) responde ao comando; se sim, guarda o resultado no comando
+static bool smartlamp_cmd_answer(struct smartlamp_cmd *c, const char *line) {
+    int prefix_len;
 
-    if (ret < 0) {
-        printk(KERN_ALERT "SmartLamp: erro ao setar o valor do %s.\n", attr_name);
-        return -EACCES;
+    // A resposta precisa começar com o prefixo esperado; o número vem logo em seguida
+    prefix_len = strlen(c->expected);
+    if (strncmp(line, c->expected, prefix_len) == 0) {
+        line += prefix_len;
+        if (c->all ? smartlamp_parse_all(line, c->reply.values, NULL) :
+                     smartlamp_parse_value(line, c->decimals, &c->reply.values[0]) != NULL) {
+            c->reply.nvalues = c->all ? SMARTLAMP_NCHANNELS : 1;
+            c->status = 0;
+            return true;
+        }
     }
 
-    return strlen(buff);
+    // O firmware recebeu o comando mas não conseguiu atendê-lo: não adianta reenviar
+    if (strncmp(line, c->error, strlen(c->error)) == 0) {
+        c->status = -EIO;
+        return true;
+    }
+
+    return false;
 }
+
+// Procura o comando pendente respondido pela linha. Sem etiqueta, só um comando sem etiqueta pode estar
+// pendente; com etiqueta, as respostas podem chegar em qualquer ordem. Chamado com resp_lock adquirido
+static struct smartlamp_cmd *smartlamp_cmd_find(struct smartlamp *sl, const char *line, bool tagged, u16 seq) {
+    enum smartlamp_proto proto = tagged ? SMARTLAMP_PROTO_TAGGED : SMARTLAMP_PROTO_TEXT;
+    struct smartlamp_cmd *c;
+
+    // Um firmware sem suporte a etiquetas responde sem etiqueta: o firmware atende na ordem de chegada.
+    // Só vale durante a negociação (protocolo texto) ou para um comando sem etiqueta; com outro protocolo,
+    // a linha é de uma requisição anterior (ex.: resposta atrasada de um teste) e não completa o comando
+    if (!tagged && strcmp(line, SMARTLAMP_UNKNOWN) == 0 && !list_empty(&sl->pending_cmds)) {
+        c = list_first_entry(&sl->pending_cmds, struct smartlamp_cmd, node);
+        if (READ_ONCE(sl->proto) == SMARTLAMP_PROTO_TEXT || c->proto == SMARTLAMP_PROTO_TEXT) {
+            c->status = -EOPNOTSUPP;
+            return c;
+        }
+        return NULL;
+    }
+
+    list_for_each_entry(c, &sl->pending_cmds, node) {
+        if (c->proto != proto || (tagged && c->seq != seq))
+            continue;
+        // Com etiqueta, o comando desconhecido é o da etiqueta: falha logo, sem esperar os reenvios
+        if (tagged && strcmp(line, SMARTLAMP_UNKNOWN) == 0) {
+            c->status = -EOPNOTSUPP;
+            return c;
+        }
+        if (smartlamp_cmd_answer(c, line))
+            return c;
+    }
+
+    return NULL;
+}
+
+// Entrega a resposta ao processo que espera pelo comando. Chamado com resp_lock adquirido
+static void smartlamp_cmd_complete(struct smartlamp *sl, struct smartlamp_cmd *c, ktime_t now) {
+    trace_smartlamp_cmd_response(sl->index, c->seq, c->status, c->reply.values[0], ktime_us_delta(now, c->start));
+    list_del_init(&c->node);                // Respostas repetidas (de reenvios) são ignoradas
+    complete(&c->done);
+}
+
+// Trata uma linha completa recebida do dispositivo. Executado no contexto do callback (atômico),
+// com resp_lock adquirido
+static void usb_process_line(void *ctx, const char *line) {
+    struct smartlamp *sl = ctx;
+    struct smartlamp_cmd *c;
+    ktime_t now = ktime_get();
+    int values[SMARTLAMP_NCHANNELS];
+    unsigned int seq = 0;
+    bool tagged = false;
+    int ch, value, age, n = 0;
+
+    dev_dbg(&sl->interface->dev, "Linha recebida: %s\n", line);
+
+    // Resposta com etiqueta: "#<seq> RES GET_LDR 42"
+    if (line[0] == '#') {
+        if (sscanf(line, "#%u %n", &seq, &n) != 1 || n == 0)
+            return;
+        tagged = true;
+        line += n;
+    }
+
+    // Toda leitura de canal que chega atualiza o cache e alimenta /dev/smartlampN
+    ch = smartlamp_parse_sample(line, &value, &age);
+    if (ch >= 0)
+        smartlamp_publish_read(sl, ch, value, smartlamp_sample_stamp(ch, now, age));
+    if (strncmp(line, "RES GET_ALL ", 12) == 0 && smartlamp_parse_all(line + 12, values, &age))
+        smartlamp_publish_all(sl, values, now, age);
+
+    // O firmware reiniciou no modo texto e voltou ao LED padrão: renegocia o protocolo e reenvia
+    // a intensidade conhecida pelo driver
+    if (strcmp(line, SMARTLAMP_HELLO) == 0) {
+        WRITE_ONCE(sl->proto, SMARTLAMP_PROTO_TEXT);
+        smartlamp_queue(sl, &sl->led_sync_work);
+        return;
+    }
+
+    // O firmware passa a enviar quadros logo depois desta linha: o próximo byte já é binário
+    if (strcmp(line, "RES BINARY 1") == 0) {
+        sl->framer.binary = true;
+        WRITE_ONCE(sl->proto, SMARTLAMP_PROTO_BINARY);
+    }
+
+    c = smartlamp_cmd_find(sl, line, tagged, seq);
+    if (!c)
+        return;
+
+    c->reply.stamp = now;
+    smartlamp_cmd_complete(sl, c, now);
+}
+
+// Codifica len bytes de src com COBS (Consistent Overhead Byte Stuffing) em dst, acrescentando o
+// delimitador 0. O resultado não tem outros bytes 0. dst precisa de len + 2 bytes. Retorna o tamanho
+static int smartlamp_cobs_encode(const u8 *src, int len, u8 *dst) {
+    int code_pos = 0, out = 1, i;
+    u8 code = 1;
+
+    for (i = 0; i < len; ++i) {
+        if (src[i] == 0) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+            continue;
+        }
+        dst[out++] = src[i];
+        if (++code == 0xff) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+        }
+    }
+    dst[code_pos] = code;
+    dst[out++] = 0;
+
+    return out;
+}
+
+// Decodifica um quadro COBS (sem o delimitador). Retorna o tamanho decodificado ou -1 se o quadro
+// é inválido ou não cabe em dst
+static int smartlamp_cobs_decode(const u8 *src, int len, u8 *dst, int size) {
+    int in = 0, out = 0, i;
+    u8 code;
+
+    while (in < len) {
+        code = src[in++];
+        if (code == 0 || in + code - 1 > len)
+            return -1;
+        for (i = 1; i < code; ++i) {
+            if (out >= size)
+                return -1;
+            dst[out++] = src[in++];
+        }
+        if (code != 0xff && in < len) {
+            if (out >= size)
+                return -1;
+            dst[out++] = 0;
+        }
+    }
+
+    return out;
+}
+
+// Monta um quadro binário: código, etiqueta, valores de 16 bits (little endian) e CRC-16/CCITT,
+// codificado com COBS e terminado em 0. Retorna o tamanho do quadro em buf
+static int smartlamp_frame_build(u8 *buf, u8 opcode, u8 seq, const int *values, int nvalues) {
+    u8 payload[SMARTLAMP_FRAME_MAX];
+    int len = 0, i;
+    u16 crc;
+
+    payload[len++] = opcode;
+    payload[len++] = seq;
+    for (i = 0; i < nvalues; ++i) {
+        payload[len++] = values[i] & 0xff;
+        payload[len++] = (values[i] >> 8) & 0xff;
+    }
+    crc = crc_ccitt(0xffff, payload, len);
+    payload[len++] = crc & 0xff;
+    payload[len++] = crc >> 8;
+
+    return smartlamp_cobs_encode(payload, len, buf);
+}
+
+// Trata um quadro binário completo recebido do dispositivo. Executado no contexto do callback (atômico),
+// com resp_lock adquirido. O quadro decodificado tem código, etiqueta, valores de 16 bits e CRC
+static void usb_process_frame(void *ctx, const u8 *frame, int len) {
+    struct smartlamp *sl = ctx;
+    struct smartlamp_cmd *c;
+    ktime_t now = ktime_get();
+    u8 payload[SMARTLAMP_FRAME_MAX];
+    int values[SMARTLAMP_MAX_VALUES] = { 0 };
+    u8 op, seq;
+    int n, i, ch, nvalues;
+
+    n = smartlamp_cobs_decode(frame, len, payload, sizeof(payload));
+    if (n < 4 || (n & 1) ||
+        crc_ccitt(0xffff, payload, n - 2) != (payload[n - 2] | payload[n - 1] << 8)) {
+        sl->framer.dropped++;
+        dev_warn_ratelimited(&sl->interface->dev, "Quadro inválido descartado (%d bytes).\n", len);
+        return;
+    }
+
+    op = payload[0];
+    seq = payload[1];
+    nvalues = min((n - 4) / 2, SMARTLAMP_MAX_VALUES);
+    for (i = 0; i < nvalues; ++i)
+        values[i] = (s16)(payload[2 + 2 * i] | payload[3 + 2 * i] << 8);
+
+    dev_dbg(&sl->interface->dev, "Quadro recebido: op=0x%02x seq=%u valores=%d\n", op, seq, nvalues);
+
+    // Toda leitura de canal que chega atualiza o cache e alimenta /dev/smartlampN. A idade da leitura,
+    // quando presente, vem depois dos valores
+    if (op == (SMARTLAMP_OP_GET_ALL | SMARTLAMP_OP_RES) && nvalues >= SMARTLAMP_NCHANNELS) {
+        smartlamp_publish_all(sl, values, now, values[SMARTLAMP_NCHANNELS]);
+    } else if ((op & SMARTLAMP_OP_RES) && nvalues > 0) {
+        for (ch = 0; ch < SMARTLAMP_NCHANNELS; ++ch) {
+            if (smartlamp_channels[ch].opcode == (op & ~SMARTLAMP_OP_RES))
+                smartlamp_publish_read(sl, ch, values[0], smartlamp_sample_stamp(ch, now, values[1]));
+        }
+    }
+
+    // Amostra do envio contínuo: não responde a nenhum comando
+    if (seq == SMARTLAMP_STREAM_SEQ)
+        return;
+
+    list_for_each_entry(c, &sl->pending_cmds, node) {
+        if (c->proto != SMARTLAMP_PROTO_BINARY || (u8)c->seq != seq ||
+            c->opcode != (op & ~(SMARTLAMP_OP_RES | SMARTLAMP_OP_ERR)))
+            continue;
+
+        if ((op & SMARTLAMP_OP_RES) && nvalues >= (c->all ? SMARTLAMP_NCHANNELS : 1)) {
+            memcpy(c->reply.values, values, sizeof(c->reply.values));
+            c->reply.nvalues = min(nvalues, SMARTLAMP_NCHANNELS);
+            c->reply.stamp = now;
+            c->status = 0;
+        } else if (op & SMARTLAMP_OP_ERR) {
+            c->status = nvalues > 0 && values[0] == SMARTLAMP_ERR_UNKNOWN ? -EOPNOTSUPP : -EIO;
+        } else {
+            return;
+        }
+
+        smartlamp_cmd_complete(sl, c, now);
+        return;
+    }
+}
+
+// Marca o primeiro byte recebido depois do envio de cada comando pendente. Chamado com resp_lock adquirido
+static void smartlamp_trace_first_rx(struct smartlamp *sl) {
+    struct smartlamp_cmd *c;
+    ktime_t now = ktime_get();
+
+    list_for_each_entry(c, &sl->pending_cmds, node) {
+        if (c->rx_seen)
+            continue;
+        c->rx_seen = true;
+        trace_smartlamp_cmd_first_rx(sl->index, c->seq, ktime_us_delta(now, c->start));
+    }
+}
+
+// Executado quando uma URB de leitura termina: processa os dados e a submete novamente
+static void usb_read_callback(struct urb *urb) {
+    struct smartlamp *sl = urb->context;
+    const char *data = urb->transfer_buffer;
+    unsigned long flags;
+    int ret;
+
+    switch (urb->status) {
+    case 0:
+        break;
+    case -ENOENT:
+    case -ECONNRESET:
+    case -ESHUTDOWN:
+        return;                             // URB cancelada (desconexão ou remoção do módulo)
+    case -EPIPE:
+        dev_err_ratelimited(&sl->interface->dev, "Endpoint IN travado (stall).\n");
+        smartlamp_queue(sl, &sl->halt_work);
+        return;
+    default:
+        // -EPROTO/-EILSEQ aparecem em rajadas durante a remoção do cabo
+        dev_err_ratelimited(&sl->interface->dev, "Erro na URB de leitura, codigo %d\n", urb->status);
+        goto resubmit;
+    }
+
+    if (urb->actual_length > 0) {
+        spin_lock_irqsave(&sl->resp_lock, flags);
+        if (trace_smartlamp_cmd_first_rx_enabled())
+            smartlamp_trace_first_rx(sl);
+        smartlamp_framer_feed(&sl->framer, data, urb->actual_length, usb_process_line, usb_process_frame, sl);
+        spin_unlock_irqrestore(&sl->resp_lock, flags);
+    }
+
+resubmit:
+    usb_anchor_urb(urb, &sl->in_anchor);
+    ret = usb_submit_urb(urb, GFP_ATOMIC);
+    if (ret) {
+        usb_unanchor_urb(urb);
+        if (ret != -EPERM && ret != -ENODEV)
+            dev_err_ratelimited(&sl->interface->dev, "Falha ao resubmeter URB de leitura, codigo %d\n", ret);
+    }
+}
+
+// Destrava o endpoint IN depois de um stall (-EPIPE) e volta a submeter todas as URBs de leitura.
+// Sem isso, as URBs travadas ficam perdidas e o dispositivo só volta a responder reconectado
+static void smartlamp_halt_work(struct work_struct *work) {
+    struct smartlamp *sl = container_of(work, struct smartlamp, halt_work);
+    int ret;
+
+    usb_kill_anchored_urbs(&sl->in_anchor); // usb_clear_halt() exige o endpoint sem URBs pendentes
+
+    ret = usb_clear_halt(sl->udev, usb_rcvbulkpipe(sl->udev, sl->usb_in));
+    if (ret) {
+        dev_err(&sl->interface->dev, "Falha ao destravar o endpoint IN, codigo %d\n", ret);
+        return;
+    }
+
+    ret = usb_start_reading(sl);
+    if (ret)
+        dev_err(&sl->interface->dev, "Falha ao submeter URBs de leitura, codigo %d\n", ret);
+}
+
+// Executado quando a URB de envio termina
+static void usb_write_callback(struct urb *urb) {
+    struct smartlamp *sl = urb->context;
+
+    trace_smartlamp_out_complete(sl->index, urb->status, urb->actual_length);
+    sl->out_status = urb->status;
+    complete(&sl->out_done);
+}
+
+// Envia buf ao dispositivo e espera a URB de envio terminar. Só o envio é serializado: as respostas
+// dos comandos com etiqueta continuam sendo esperadas em paralelo
+static int usb_write_out(struct smartlamp *sl, const char *buf, int len) {
+    int ret;
+
+    mutex_lock(&sl->out_lock);
+
+    len = min(len, sl->usb_max_size);
+    memcpy(sl->usb_out_buffer, buf, len);
+
+    reinit_completion(&sl->out_done);
+    usb_fill_bulk_urb(sl->out_urb, sl->udev,
+                      usb_sndbulkpipe(sl->udev, sl->usb_out),
+                      sl->usb_out_buffer, len, usb_write_callback, sl);
+
+    ret = usb_submit_urb(sl->out_urb, GFP_KERNEL);
+    if (ret)
+        goto out;
+
+    if (!wait_for_completion_timeout(&sl->out_done, msecs_to_jiffies(SMARTLAMP_TIMEOUT_MS))) {
+        usb_kill_urb(sl->out_urb);
+        ret = -ETIMEDOUT;
+        goto out;
+    }
+
+    ret = sl->out_status;
+out:
+    mutex_unlock(&sl->out_lock);
+    return ret;
+}
+
+// Guarda o tempo de resposta de um comando bem-sucedido
+static void usb_record_rtt(struct smartlamp *sl, ktime_t start) {
+    unsigned long flags;
+    s64 us = ktime_us_delta(ktime_get(), start);
+
+    spin_lock_irqsave(&sl->rtt_lock, flags);
+    sl->rtt_samples[sl->rtt_next] = min_t(s64, us, U32_MAX);
+    sl->rtt_next = (sl->rtt_next + 1) % SMARTLAMP_RTT_SAMPLES;
+    if (sl->rtt_count < SMARTLAMP_RTT_SAMPLES)
+        sl->rtt_count++;
+    sl->rtt_hist[us > 0 ? min_t(unsigned int, ilog2(us), SMARTLAMP_HIST_BUCKETS - 1) : 0]++;
+    spin_unlock_irqrestore(&sl->rtt_lock, flags);
+}
+
+// Contadores do comando, criados no primeiro uso. Chamado com rtt_lock adquirido
+static struct smartlamp_cmd_stats *usb_cmd_stats(struct smartlamp *sl, const char *cmd) {
+    struct smartlamp_cmd_stats *st;
+    int i;
+
+    for (i = 0; i < SMARTLAMP_CMD_STATS - 1; ++i) {
+        st = &sl->cmd_stats[i];
+        if (!st->cmd[0])
+            strscpy(st->cmd, cmd, sizeof(st->cmd));
+        if (strcmp(st->cmd, cmd) == 0)
+            return st;
+    }
+    st = &sl->cmd_stats[i];
+    if (!st->cmd[0])
+        strscpy(st->cmd, "(outros)", sizeof(st->cmd));
+    return st;
+}
+
+// Conta o resultado de um comando (ret) e seus reenvios nos contadores do comando
+static void usb_record_stats(struct smartlamp *sl, const char *cmd, int ret, int resends) {
+    struct smartlamp_cmd_stats *st;
+    unsigned long flags;
+
+    spin_lock_irqsave(&sl->rtt_lock, flags);
+    st = usb_cmd_stats(sl, cmd);
+    st->sent++;
+    st->retries += resends;
+    if (!ret)
+        st->ok++;
+    else if (ret == -ETIMEDOUT)
+        st->timeouts++;
+    else
+        st->errors++;
+    spin_unlock_irqrestore(&sl->rtt_lock, flags);
+}
+
+// Comandos que não leem um canal, com seus códigos no modo binário
+static const struct {
+    const char *cmd;
+    u8 opcode;
+    int arg;                                       // Valor enviado antes do parâmetro no quadro (-1: nenhum)
+} smartlamp_opcodes[] = {
+    { "SET_LED_FADE",      SMARTLAMP_OP_SET_LED_FADE, -1                 },
+    { "SET_LED",           SMARTLAMP_OP_SET_LED,      -1                 },
+    { "GET_ALL",           SMARTLAMP_OP_GET_ALL,      -1                 },
+    { "STREAM_START LDR",  SMARTLAMP_OP_STREAM_START, SMARTLAMP_CH_LDR   },
+    { "STREAM_START TEMP", SMARTLAMP_OP_STREAM_START, SMARTLAMP_CH_TEMP  },
+    { "STREAM_START HUM",  SMARTLAMP_OP_STREAM_START, SMARTLAMP_CH_HUM   },
+    { "STREAM_STOP",       SMARTLAMP_OP_STREAM_STOP,  -1                 },
+    { "GET_LDR_RAW",       SMARTLAMP_OP_GET_LDR_RAW,  -1                 },
+    { "LDR_FILTER NONE",   SMARTLAMP_OP_LDR_FILTER,   SMARTLAMP_LDR_FILTER_NONE   },
+    { "LDR_FILTER AVG",    SMARTLAMP_OP_LDR_FILTER,   SMARTLAMP_LDR_FILTER_AVG    },
+    { "LDR_FILTER MEDIAN", SMARTLAMP_OP_LDR_FILTER,   SMARTLAMP_LDR_FILTER_MEDIAN },
+};
+
+// Procura o canal lido por um comando (e.g., GET_TEMP -> SMARTLAMP_CH_TEMP); -1 se o comando não lê um canal
+static int smartlamp_cmd_channel(const char *cmd) {
+    int ch;
+
+    for (ch = 0; ch < SMARTLAMP_NCHANNELS; ++ch) {
+        if (strcmp(cmd, smartlamp_channels[ch].cmd) == 0)
+            return ch;
+    }
+
+    return -1;
+}
+
+// Código no modo binário de um comando que não lê um canal, e em *arg o valor que vai antes do parâmetro;
+// 0 se o comando só existe no modo texto
+static u8 smartlamp_cmd_opcode(const char *cmd, int *arg) {
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(smartlamp_opcodes); ++i) {
+        if (strcmp(cmd, smartlamp_opcodes[i].cmd) == 0) {
+            *arg = smartlamp_opcodes[i].arg;
+            return smartlamp_opcodes[i].opcode;
+        }
+    }
+
+    *arg = -1;
+    return 0;
+}
+
+// Libera cmd_sem adquirido por smartlamp_cmd_lock para o protocolo proto
+static void smartlamp_cmd_unlock(struct smartlamp *sl, enum smartlamp_proto proto) {
+    if (proto == SMARTLAMP_PROTO_TEXT)
+        up_write(&sl->cmd_sem);
+    else
+        up_read(&sl->cmd_sem);
+}
+
+// Adquire cmd_sem para enviar um comando. Sem etiqueta, a resposta só é reconhecida pelo prefixo: nenhum
+// outro comando pode estar em andamento (escrita); nos demais protocolos, vários comandos convivem (leitura).
+// Com SMARTLAMP_PROTO_AUTO, *proto recebe o protocolo negociado, conferido de novo depois de adquirir
+// cmd_sem, porque a negociação pode tê-lo mudado enquanto o processo esperava
+static int smartlamp_cmd_lock(struct smartlamp *sl, enum smartlamp_proto *proto) {
+    bool automatic = *proto == SMARTLAMP_PROTO_AUTO;
+    int ret;
+
+    for (;;) {
+        if (automatic)
+            *proto = READ_ONCE(sl->proto);
+
+        if (*proto == SMARTLAMP_PROTO_TEXT)
+            ret = down_write_killable(&sl->cmd_sem);
+        else
+            ret = down_read_killable(&sl->cmd_sem);
+        if (ret)
+            return ret;
+
+        if (!automatic || READ_ONCE(sl->proto) == *proto)
+            return 0;
+
+        smartlamp_cmd_unlock(sl, *proto);
+    }
+}
+
+// Envia um comando via USB, espera e retorna a resposta do dispositivo (convertido para int) em *value
+// Exemplo de Comando:  SET_LED 80          (com etiqueta: #7 SET_LED 80)
+// Exemplo de Resposta: RES SET_LED 1       (com etiqueta: #7 RES SET_LED 1)
+// Exemplo de chamada da função usb_send_cmd para SET_LED: usb_send_cmd(sl, "SET_LED", 80, &value);
+// A resposta é entregue pelo callback das URBs de leitura, que ficam sempre submetidas: o processo acorda
+// assim que ela chega. O comando só é reenviado se nada chegar, com espera dobrando a cada tentativa.
+// Com etiqueta (ou no modo binário), vários comandos ficam em andamento ao mesmo tempo e as respostas
+// podem vir fora de ordem. arg vai antes de param, para comandos com dois valores (e.g., SET_LED_FADE 80 500;
+// -1: nenhum). proto é o protocolo já resolvido; cmd_sem precisa estar adquirido como smartlamp_cmd_lock faz
+// para ele. Retorna 0 em caso de sucesso ou um código de erro negativo.
+static int __usb_send_cmd_locked(struct smartlamp *sl, char *cmd, int arg, int param, struct smartlamp_reply *reply,
+                                 enum smartlamp_proto proto) {
+    struct device *dev = &sl->interface->dev;
+    struct smartlamp_cmd c;
+    char buf[MAX_RECV_LINE];
+    int ret, len, ch;
+    int retries = SMARTLAMP_RETRIES, attempts = 0;
+    unsigned int wait_ms = SMARTLAMP_RESP_MIN_MS;
+    unsigned long flags;
+    long left;
+
+    ch = smartlamp_cmd_channel(cmd);
+    c.proto = proto;
+    c.arg = -1;
+    c.opcode = ch >= 0 ? smartlamp_channels[ch].opcode : smartlamp_cmd_opcode(cmd, &c.arg);
+    if (arg != -1)
+        c.arg = arg;
+    c.decimals = ch >= 0 ? smartlamp_channels[ch].decimals : 0;
+    c.all = strcmp(cmd, "GET_ALL") == 0;
+    // Prefixo esperado com espaço para facilitar o parsing. O firmware repete arg na resposta
+    if (arg != -1)
+        snprintf(c.expected, MAX_RECV_LINE, "RES %s %d ", cmd, arg);
+    else
+        snprintf(c.expected, MAX_RECV_LINE, "RES %s ", cmd);
+    snprintf(c.error, MAX_RECV_LINE, "ERR %s", cmd);
+    init_completion(&c.done);
+    c.status = -ETIMEDOUT;
+    c.rx_seen = false;
+
+    if (proto == SMARTLAMP_PROTO_BINARY && !c.opcode)
+        return -EOPNOTSUPP;                 // Comando sem equivalente no modo binário
+
+    spin_lock_irqsave(&sl->resp_lock, flags);
+    if (sl->disconnected) {
+        spin_unlock_irqrestore(&sl->resp_lock, flags);
+        return -ENODEV;
+    }
+    c.seq = sl->next_seq++;
+    if (proto == SMARTLAMP_PROTO_BINARY && (u8)c.seq == SMARTLAMP_STREAM_SEQ)
+        c.seq = sl->next_seq++;
+    c.start = ktime_get();
+    list_add_tail(&c.node, &sl->pending_cmds);
+    spin_unlock_irqrestore(&sl->resp_lock, flags);
+
+    if (proto == SMARTLAMP_PROTO_BINARY) {
+        int values[2], nvalues = 0;
+
+        if (c.arg != -1)
+            values[nvalues++] = c.arg;
+        if (param != -1)
+            values[nvalues++] = param;
+        len = smartlamp_frame_build((u8 *)buf, c.opcode, c.seq, values, nvalues);
+        dev_dbg(dev, "Enviando comando: %s (op=0x%02x seq=%u)\n", cmd, c.opcode, c.seq & 0xff);
+    } else {
+        len = proto == SMARTLAMP_PROTO_TAGGED ? scnprintf(buf, sizeof(buf), "#%u ", c.seq) : 0;
+        if (param == -1) {
+            len += scnprintf(buf + len, sizeof(buf) - len, "%s\n", cmd);
+        } else if (arg == -1) {
+            len += scnprintf(buf + len, sizeof(buf) - len, "%s %d\n", cmd, param);
+        } else {
+            len += scnprintf(buf + len, sizeof(buf) - len, "%s %d %d\n", cmd, arg, param);
+        }
+        dev_dbg(dev, "Enviando comando: %.*s\n", len - 1, buf);
+    }
+    trace_smartlamp_cmd_submit(sl->index, c.seq, proto, cmd, param);
+
+    ret = -ETIMEDOUT;
+    while (retries > 0) {
+        attempts++;
+        ret = usb_write_out(sl, buf, len);
+        if (ret) {
+            dev_err(dev, "Erro ao enviar comando (tentativa %d), codigo %d!\n", retries, ret);
+            if (ret != -ETIMEDOUT)
+                break;
+            retries--;
+            continue;
+        }
+
+        // Dorme até o callback de leitura encontrar a resposta (ou o tempo acabar)
+        left = wait_for_completion_killable_timeout(&c.done, msecs_to_jiffies(wait_ms));
+        if (left > 0) {
+            ret = 0;
+            break;
+        }
+        if (left < 0) {
+            ret = left;                     // Processo recebeu um sinal fatal
+            break;
+        }
+
+        ret = -ETIMEDOUT;
+        dev_dbg(dev, "Resposta não recebida em %u ms (tentativa %d), reenviando...\n",
+                wait_ms, retries);
+        trace_smartlamp_cmd_retry(sl->index, c.seq, attempts, wait_ms);
+        wait_ms = min_t(unsigned int, wait_ms * 2, SMARTLAMP_RESP_MAX_MS);
+        retries--;
+    }
+
+    // Um comando fora da lista já foi respondido (ou falhou pela desconexão), mesmo que o tempo tenha acabado
+    spin_lock_irqsave(&sl->resp_lock, flags);
+    if (list_empty(&c.node))
+        ret = c.status;
+    else
+        list_del(&c.node);
+    spin_unlock_irqrestore(&sl->resp_lock, flags);
+
+    usb_record_stats(sl, cmd, ret, max(attempts - 1, 0));
+    if (ret == -ETIMEDOUT)
+        trace_smartlamp_cmd_timeout(sl->index, c.seq, cmd);
+
+    if (!ret) {
+        *reply = c.reply;
+        dev_dbg(dev, "Valor extraído: %d\n", c.reply.values[0]);
+        usb_record_rtt(sl, c.start);
+    } else {
+        dev_err(dev, "Falha ao obter resposta válida, codigo %d.\n", ret);
+    }
+
+    // O firmware aceitou a nova velocidade e troca logo depois de responder: a ponte troca antes de liberar
+    // cmd_sem (BAUD só existe no modo texto, com cmd_sem em escrita), e nenhum comando sai na velocidade antiga
+    if (!ret && strcmp(cmd, "BAUD") == 0 && c.reply.values[0] == param)
+        ret = smartlamp_set_line(sl, param);
+
+    // Sem resposta em velocidade alta: o firmware provavelmente reiniciou em SMARTLAMP_BAUD_BOOT, e o
+    // SMARTLAMP_HELLO se perdeu. led_sync_work procura a velocidade e renegocia
+    if (ret == -ETIMEDOUT && READ_ONCE(sl->baud) != SMARTLAMP_BAUD_BOOT && current_work() != &sl->led_sync_work)
+        smartlamp_queue(sl, &sl->led_sync_work);
+
+    return ret;
+}
+
+// Envia um comando com __usb_send_cmd_locked, adquirindo cmd_sem. proto escolhe o protocolo
+// (SMARTLAMP_PROTO_AUTO: o negociado)
+static int __usb_send_cmd(struct smartlamp *sl, char *cmd, int arg, int param, struct smartlamp_reply *reply,
+                          enum smartlamp_proto proto) {
+    int ret;
+
+    ret = smartlamp_cmd_lock(sl, &proto);
+    if (ret)
+        return ret;
+
+    ret = __usb_send_cmd_locked(sl, cmd, arg, param, reply, proto);
+    smartlamp_cmd_unlock(sl, proto);
+    return ret;
+}
+
+static void smartlamp_flight_release(struct kref *kref) {
+    kfree(container_of(kref, struct smartlamp_flight, kref));
+}
+
+// Faz a leitura cmd ou, se a mesma leitura já está em andamento, espera por ela e recebe a mesma resposta.
+// Com N processos lendo o mesmo arquivo, o dispositivo recebe um comando por vez, não N
+static int smartlamp_flight_do(struct smartlamp *sl, char *cmd, struct smartlamp_reply *reply) {
+    struct smartlamp_flight *f, *new;
+    unsigned long flags;
+    int ret;
+
+again:
+    new = kzalloc(sizeof(*new), GFP_KERNEL);
+    if (!new)
+        return -ENOMEM;
+
+    spin_lock_irqsave(&sl->flight_lock, flags);
+    list_for_each_entry(f, &sl->flights, node) {
+        if (strcmp(f->cmd, cmd) == 0) {
+            kref_get(&f->kref);
+            spin_unlock_irqrestore(&sl->flight_lock, flags);
+            kfree(new);
+            goto wait;
+        }
+    }
+    f = new;
+    kref_init(&f->kref);
+    f->cmd = cmd;
+    init_completion(&f->done);
+    list_add_tail(&f->node, &sl->flights);
+    spin_unlock_irqrestore(&sl->flight_lock, flags);
+
+    f->ret = __usb_send_cmd(sl, cmd, -1, -1, &f->reply, SMARTLAMP_PROTO_AUTO);
+
+    spin_lock_irqsave(&sl->flight_lock, flags);
+    list_del_init(&f->node);                // Quem chegar agora envia um comando novo
+    spin_unlock_irqrestore(&sl->flight_lock, flags);
+    complete_all(&f->done);
+    goto out;
+
+wait:
+    ret = wait_for_completion_killable(&f->done);
+    if (ret) {
+        kref_put(&f->kref, smartlamp_flight_release);
+        return ret;
+    }
+
+    // Quem enviava recebeu um sinal fatal e desistiu: a leitura é refeita por este processo
+    if (f->ret == -EINTR || f->ret == -ERESTARTSYS) {
+        kref_put(&f->kref, smartlamp_flight_release);
+        goto again;
+    }
+
+    spin_lock_irqsave(&sl->rtt_lock, flags);
+    usb_cmd_stats(sl, cmd)->shared++;
+    spin_unlock_irqrestore(&sl->rtt_lock, flags);
+
+out:
+    ret = f->ret;
+    if (!ret)
+        *reply = f->reply;
+    kref_put(&f->kref, smartlamp_flight_release);
+    return ret;
+}
+
+// Envia um comando no protocolo negociado com o firmware e retorna todos os valores da resposta.
+// Leituras sem parâmetro iguais e simultâneas compartilham um único comando
+static int usb_send_cmd_reply(struct smartlamp *sl, char *cmd, int param, struct smartlamp_reply *reply) {
+    if (param == -1 && strncmp(cmd, "GET_", 4) == 0)
+        return smartlamp_flight_do(sl, cmd, reply);
+
+    return __usb_send_cmd(sl, cmd, -1, param, reply, SMARTLAMP_PROTO_AUTO);
+}
+
+// Envia um comando no protocolo negociado com o firmware
+static int usb_send_cmd(struct smartlamp *sl, char *cmd, int param, int *value) {
+    struct smartlamp_reply reply;
+    int ret;
+
+    ret = usb_send_cmd_reply(sl, cmd, param, &reply);
+    if (!ret)
+        *value = reply.values[0];
+    return ret;
+}
+
+
+// Atualiza o valor de um canal no cache
+static void smartlamp_cache_store(struct smartlamp *sl, enum smartlamp_channel ch, int value, ktime_t stamp) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&sl->cache_lock, flags);
+    sl->cache[ch].value = value;
+    sl->cache[ch].stamp = stamp;
+    sl->cache[ch].valid = true;
+    spin_unlock_irqrestore(&sl->cache_lock, flags);
+}
+
+// Grava um registro no anel mapeável. Único produtor: chamado com readers_lock adquirido
+static void smartlamp_ring_put(struct smartlamp *sl, const struct smartlamp_record *rec) {
+    struct smartlamp_ring_page *page = sl->ring_page;
+    u64 tail;
+
+    // A leitura de data_tail precisa acontecer antes de sobrescrever o registro que o consumidor
+    // acabou de liberar (par da barreira de liberação do consumidor ao escrever data_tail)
+    tail = smp_load_acquire(&page->data_tail);
+    if (sl->ring_head - tail >= SMARTLAMP_RING_RECORDS) {
+        WRITE_ONCE(page->lost, page->lost + 1);
+        return;
+    }
+
+    // Posição mantida à parte para não dividir um u64 a cada registro
+    sl->ring_data[sl->ring_pos] = *rec;
+    if (++sl->ring_pos == SMARTLAMP_RING_RECORDS)
+        sl->ring_pos = 0;
+    ++sl->ring_head;
+
+    // O registro fica visível antes do novo data_head (par da aquisição do consumidor ao ler data_head)
+    smp_store_release(&page->data_head, sl->ring_head);
+}
+
+// Entrega um novo valor de um canal: atualiza o cache e coloca um registro na fila de cada leitor de
+// /dev/smartlampN. Pode ser executado no contexto do callback (atômico)
+static void smartlamp_publish(struct smartlamp *sl, enum smartlamp_channel ch, int value, ktime_t stamp) {
+    struct smartlamp_reader *reader;
+    struct smartlamp_record rec;
+    unsigned long flags;
+
+    smartlamp_cache_store(sl, ch, value, stamp);
+
+    rec.channel = ch;
+    rec.value = value;
+    rec.timestamp_ns = ktime_to_ns(stamp);
+
+    spin_lock_irqsave(&sl->readers_lock, flags);
+    smartlamp_ring_put(sl, &rec);
+    list_for_each_entry(reader, &sl->readers, node) {
+        if (!kfifo_put(&reader->fifo, rec))
+            reader->lost++;
+    }
+    spin_unlock_irqrestore(&sl->readers_lock, flags);
+
+    wake_up_interruptible(&sl->read_wait);
+}
+
+// Entrega um valor lido do dispositivo. O LED só é lido enquanto a cópia local não é válida: depois disso
+// só o driver o muda, e uma leitura (e.g., o valor padrão do firmware reiniciado, antes de led_sync_work
+// reenviar a intensidade) não pode sobrescrevê-la
+static void smartlamp_publish_read(struct smartlamp *sl, enum smartlamp_channel ch, int value, ktime_t stamp) {
+    unsigned long flags;
+    bool shadow;
+
+    spin_lock_irqsave(&sl->cache_lock, flags);
+    shadow = ch == SMARTLAMP_CH_LED && sl->cache[ch].valid;
+    spin_unlock_irqrestore(&sl->cache_lock, flags);
+
+    if (!shadow)
+        smartlamp_publish(sl, ch, value, stamp);
+}
+
+// Entrega os valores de todos os canais lidos no mesmo instante (GET_ALL). Canais sem leitura são ignorados
+static void smartlamp_publish_all(struct smartlamp *sl, const int *values, ktime_t now, int age_ms) {
+    int ch;
+
+    for (ch = 0; ch < SMARTLAMP_NCHANNELS; ++ch) {
+        if (values[ch] != SMARTLAMP_VALUE_NAN)
+            smartlamp_publish_read(sl, ch, values[ch], smartlamp_sample_stamp(ch, now, age_ms));
+    }
+}
+
+// Lê um canal do dispositivo. O valor é guardado no cache pelo caminho de leitura (smartlamp_publish)
+static int smartlamp_sample(struct smartlamp *sl, enum smartlamp_channel ch, int *value) {
+    return usb_send_cmd(sl, smartlamp_channels[ch].cmd, -1, value);
+}
+
+// Retorna o valor de um canal: do cache, se o canal é amostrado em segundo plano e o valor não é mais
+// velho que max_age_ms, ou lendo do dispositivo caso contrário
+static int smartlamp_read_channel(struct smartlamp *sl, enum smartlamp_channel ch, int *value) {
+    unsigned int max_age = READ_ONCE(sl->max_age_ms);
+    unsigned long flags;
+    bool hit;
+
+    spin_lock_irqsave(&sl->cache_lock, flags);
+    if (ch == SMARTLAMP_CH_LED)
+        hit = sl->cache[ch].valid;          // Só o driver muda o LED: a cópia local nunca fica velha
+    else
+        hit = (READ_ONCE(sl->interval_ms[ch]) || READ_ONCE(sl->stream_hz[ch])) && sl->cache[ch].valid &&
+              (!max_age || ktime_ms_delta(ktime_get(), sl->cache[ch].stamp) <= max_age);
+    if (hit)
+        *value = sl->cache[ch].value;
+    spin_unlock_irqrestore(&sl->cache_lock, flags);
+
+    if (hit)
+        return 0;
+
+    return smartlamp_sample(sl, ch, value);
+}
+
+// Amostra os canais cujo intervalo venceu e agenda a próxima execução para o canal mais próximo de vencer
+static void smartlamp_sample_work(struct work_struct *work) {
+    struct smartlamp *sl = container_of(to_delayed_work(work), struct smartlamp, sample_work);
+    ktime_t next = KTIME_MAX;
+    unsigned int interval;
+    int ch, value;
+    s64 delay_ms;
+
+    for (ch = 0; ch < SMARTLAMP_NCHANNELS; ++ch) {
+        interval = READ_ONCE(sl->interval_ms[ch]);
+        if (!interval || READ_ONCE(sl->stream_hz[ch]))
+            continue;                       // Sem amostragem, ou o firmware já envia o canal sozinho
+
+        if (!ktime_before(ktime_get(), sl->next_sample[ch])) {
+            if (smartlamp_sample(sl, ch, &value) == -ENODEV)
+                return;
+            sl->next_sample[ch] = ktime_add_ms(ktime_get(), interval);
+        }
+
+        if (ktime_before(sl->next_sample[ch], next))
+            next = sl->next_sample[ch];
+    }
+
+    if (next == KTIME_MAX)
+        return;                             // Nenhum canal com amostragem ativa
+
+    delay_ms = max_t(s64, ktime_ms_delta(next, ktime_get()), 0);
+    queue_delayed_work(smartlamp_wq, &sl->sample_work, msecs_to_jiffies(delay_ms));
+}
+
+// Canais IIO: o valor bruto é o mesmo de /dev/smartlampN e a escala converte os décimos de temperatura e
+// umidade para as unidades do IIO (milésimos de grau e de ponto percentual). address guarda o canal do driver
+#define SMARTLAMP_IIO_CHANNEL(_type, _ch, _index, _scale) {                        \
+    .type = (_type),                                                              \
+    .address = (_ch),                                                             \
+    .info_mask_separate = BIT(IIO_CHAN_INFO_RAW) | ((_scale) ? BIT(IIO_CHAN_INFO_SCALE) : 0), \
+    .scan_index = (_index),                                                       \
+    .scan_type = {                                                                \
+        .sign = 's',                                                              \
+        .realbits = 16,                                                           \
+        .storagebits = 16,                                                        \
+        .endianness = IIO_CPU,                                                    \
+    },                                                                            \
+}
+
+static const struct iio_chan_spec smartlamp_iio_channels[] = {
+    SMARTLAMP_IIO_CHANNEL(IIO_INTENSITY, SMARTLAMP_CH_LDR, 0, false),
+    SMARTLAMP_IIO_CHANNEL(IIO_TEMP, SMARTLAMP_CH_TEMP, 1, true),
+    SMARTLAMP_IIO_CHANNEL(IIO_HUMIDITYRELATIVE, SMARTLAMP_CH_HUM, 2, true),
+    IIO_CHAN_SOFT_TIMESTAMP(3),
+};
+
+// Leitura de in_*_raw e in_*_scale
+static int smartlamp_iio_read_raw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+                                  int *val, int *val2, long mask) {
+    struct smartlamp *sl = iio_device_get_drvdata(indio_dev);
+    int ret;
+
+    switch (mask) {
+    case IIO_CHAN_INFO_RAW:
+        ret = smartlamp_read_channel(sl, chan->address, val);
+        return ret ? ret : IIO_VAL_INT;
+    case IIO_CHAN_INFO_SCALE:
+        *val = 100;                         // Décimos -> milésimos
+        return IIO_VAL_INT;
+    default:
+        return -EINVAL;
+    }
+}
+
+static const struct iio_info smartlamp_iio_info = {
+    .read_raw = smartlamp_iio_read_raw,
+};
+
+// Executado a cada disparo do gatilho (hrtimer, sysfs, ...), em uma thread: coloca no buffer os canais
+// ativos. Como nos arquivos do sysfs, os valores vêm do cache alimentado pela amostragem em segundo plano
+// ou pelo envio contínuo, e só geram um comando na USB quando o cache está velho
+static irqreturn_t smartlamp_iio_trigger_handler(int irq, void *p) {
+    struct iio_poll_func *pf = p;
+    struct iio_dev *indio_dev = pf->indio_dev;
+    struct smartlamp *sl = iio_device_get_drvdata(indio_dev);
+    struct {
+        s16 values[ARRAY_SIZE(smartlamp_iio_channels) - 1];
+        s64 timestamp __aligned(8);
+    } scan = { };
+    int bit, i = 0, value;
+
+    iio_for_each_active_channel(indio_dev, bit) {
+        if (smartlamp_read_channel(sl, indio_dev->channels[bit].address, &value))
+            goto done;                      // Sem leitura válida: descarta a amostra inteira
+        scan.values[i++] = value;
+    }
+
+    iio_push_to_buffers_with_timestamp(indio_dev, &scan, pf->timestamp);
+
+done:
+    iio_trigger_notify_done(indio_dev->trig);
+    return IRQ_HANDLED;
+}
+
+// Registra os sensores como um dispositivo IIO filho de lampN, com um buffer (kfifo) preenchido por gatilho
+static int smartlamp_iio_register(struct smartlamp *sl) {
+    struct iio_dev *indio_dev;
+    int ret;
+
+    indio_dev = iio_device_alloc(sl->dev, 0);
+    if (!indio_dev)
+        return -ENOMEM;
+
+    iio_device_set_drvdata(indio_dev, sl);
+    indio_dev->name = "smartlamp";
+    indio_dev->label = dev_name(sl->dev);   // lampN: distingue as lâmpadas, que têm o mesmo nome
+    indio_dev->info = &smartlamp_iio_info;
+    indio_dev->modes = INDIO_DIRECT_MODE;
+    indio_dev->channels = smartlamp_iio_channels;
+    indio_dev->num_channels = ARRAY_SIZE(smartlamp_iio_channels);
+
+    ret = iio_triggered_buffer_setup(indio_dev, iio_pollfunc_store_time, smartlamp_iio_trigger_handler, NULL);
+    if (ret)
+        goto err_free;
+
+    ret = iio_device_register(indio_dev);
+    if (ret)
+        goto err_buffer;
+
+    sl->iio = indio_dev;
+    return 0;
+
+err_buffer:
+    iio_triggered_buffer_cleanup(indio_dev);
+err_free:
+    iio_device_free(indio_dev);
+    return ret;
+}
+
+static void smartlamp_iio_unregister(struct smartlamp *sl) {
+    if (!sl->iio)
+        return;
+
+    iio_device_unregister(sl->iio);
+    iio_triggered_buffer_cleanup(sl->iio);
+    iio_device_free(sl->iio);
+    sl->iio = NULL;
+}
+
+// Retorna o canal correspondente a um arquivo do sysfs ("ldr", "ldr_interval_ms", ...) ou -1
+static int smartlamp_attr_channel(const char *attr_name) {
+    int ch, len;
+
+    for (ch = 0; ch < SMARTLAMP_NCHANNELS; ++ch) {
+        len = strlen(smartlamp_channels[ch].name);
+        if (strncmp(attr_name, smartlamp_channels[ch].name, len) == 0 &&
+            (attr_name[len] == '\0' || attr_name[len] == '_'))
+            return ch;
+    }
+
+    return -1;
+}
+
+// Escreve o valor de um canal em buff + at, seguido de end. Temperatura e umidade são guardadas em
+// décimos: 234 -> "23.4". Retorna a quantidade de caracteres escritos
+static int smartlamp_emit_value(char *buff, int at, enum smartlamp_channel ch, int value, const char *end) {
+    if (value == SMARTLAMP_VALUE_NAN)
+        return sysfs_emit_at(buff, at, "nan%s", end);
+
+    if (smartlamp_channels[ch].decimals)
+        return sysfs_emit_at(buff, at, "%s%d.%d%s", value < 0 ? "-" : "", abs(value) / 10, abs(value) % 10, end);
+
+    return sysfs_emit_at(buff, at, "%d%s", value, end);
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/{led, ldr, temp, hum} é lido (e.g., cat /sys/class/smartlamp/lamp0/led)
+static ssize_t attr_show(struct device *dev, struct device_attribute *attr, char *buff) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    // value representa o valor do led ou ldr
+    int value, ret;
+    // attr_name representa o nome do arquivo que está sendo lido (ldr ou led)
+    const char *attr_name = attr->attr.name;
+    int ch = smartlamp_attr_channel(attr_name);
+
+    if (ch < 0)
+        return -EINVAL;
+
+    // Sensores amostrados em segundo plano são respondidos do cache, sem acessar a USB
+    ret = smartlamp_read_channel(sl, ch, &value);
+    if (ret)
+        return ret;
+
+    return smartlamp_emit_value(buff, 0, ch, value, "\n");
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/snapshot é lido: todos os canais lidos no mesmo
+// instante com um único comando (GET_ALL), e.g., "led=50 ldr=42 temp=23.4 hum=61.0 timestamp_ns=..."
+static ssize_t snapshot_show(struct device *dev, struct device_attribute *attr, char *buff) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    struct smartlamp_reply reply;
+    int ch, ret, len = 0;
+
+    ret = usb_send_cmd_reply(sl, "GET_ALL", -1, &reply);
+
+    // Firmware sem GET_ALL: um comando por canal, com o instante do fim da leitura
+    if (ret == -EOPNOTSUPP) {
+        for (ch = 0; ch < SMARTLAMP_NCHANNELS; ++ch) {
+            if (smartlamp_sample(sl, ch, &reply.values[ch]))
+                reply.values[ch] = SMARTLAMP_VALUE_NAN;
+        }
+        reply.stamp = ktime_get();
+        ret = 0;
+    }
+    if (ret)
+        return ret;
+
+    for (ch = 0; ch < SMARTLAMP_NCHANNELS; ++ch) {
+        len += sysfs_emit_at(buff, len, "%s=", smartlamp_channels[ch].name);
+        len += smartlamp_emit_value(buff, len, ch, reply.values[ch], " ");
+    }
+    len += sysfs_emit_at(buff, len, "timestamp_ns=%lld\n", ktime_to_ns(reply.stamp));
+
+    return len;
+}
+
+
+// Muda a intensidade do LED. O driver é o único que altera o LED, então mantém uma cópia local: valores
+// fora da faixa do firmware são recusados e valores iguais ao atual não geram comando na USB
+static int smartlamp_set_led(struct smartlamp *sl, int level) {
+    unsigned long flags;
+    bool same;
+    int ret, resp = 0;
+
+    if (level < 0 || level > SMARTLAMP_LED_MAX)
+        return -EINVAL;
+
+    ret = mutex_lock_interruptible(&sl->led_lock);
+    if (ret)
+        return ret;
+
+    spin_lock_irqsave(&sl->cache_lock, flags);
+    same = sl->cache[SMARTLAMP_CH_LED].valid && sl->cache[SMARTLAMP_CH_LED].value == level;
+    spin_unlock_irqrestore(&sl->cache_lock, flags);
+
+    if (!same) {
+        ret = usb_send_cmd(sl, "SET_LED", level, &resp);
+        if (!ret && resp != 1)
+            ret = -EIO;
+        if (!ret)
+            smartlamp_publish(sl, SMARTLAMP_CH_LED, level, ktime_get());
+    }
+
+    mutex_unlock(&sl->led_lock);
+    return ret;
+}
+
+// Leva o LED até level em ms milissegundos com um único comando: o firmware faz a transição no hardware
+static int smartlamp_led_fade(struct smartlamp *sl, int level, int ms) {
+    struct smartlamp_reply reply;
+    int ret;
+
+    if (level < 0 || level > SMARTLAMP_LED_MAX || ms < 0 || ms > SMARTLAMP_FADE_MAX_MS)
+        return -EINVAL;
+
+    ret = mutex_lock_interruptible(&sl->led_lock);
+    if (ret)
+        return ret;
+
+    ret = __usb_send_cmd(sl, "SET_LED_FADE", level, ms, &reply, SMARTLAMP_PROTO_AUTO);
+    if (!ret && reply.values[0] != 1)
+        ret = -EIO;
+    if (!ret)
+        smartlamp_publish(sl, SMARTLAMP_CH_LED, level, ktime_get()); // A cópia local já guarda o destino
+
+    mutex_unlock(&sl->led_lock);
+    return ret;
+}
+
+// Os pedidos de LED até gen já foram enviados
+static bool smartlamp_led_done(struct smartlamp *sl, u64 gen) {
+    unsigned long flags;
+    bool done;
+
+    spin_lock_irqsave(&sl->led_req_lock, flags);
+    done = sl->led_done_gen >= gen;
+    spin_unlock_irqrestore(&sl->led_req_lock, flags);
+    return done;
+}
+
+// Pede a intensidade level sem esperar o dispositivo. Pedidos feitos enquanto um SET_LED está em andamento
+// se substituem: quando o envio termina, só o mais recente é enviado
+static void smartlamp_led_request(struct smartlamp *sl, int level) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&sl->led_req_lock, flags);
+    sl->led_req = level;
+    sl->led_req_gen++;
+    spin_unlock_irqrestore(&sl->led_req_lock, flags);
+
+    queue_work(smartlamp_wq, &sl->led_work);
+}
+
+// brightness_set da classe de LEDs. Os gatilhos chamam a partir de timers (contexto atômico), então só
+// registra o pedido: led_work faz o envio e, se o gatilho mudar o valor mais rápido que a USB responde,
+// envia só o mais recente
+static void smartlamp_led_cdev_set(struct led_classdev *cdev, enum led_brightness value) {
+    smartlamp_led_request(container_of(cdev, struct smartlamp, led_cdev), value);
+}
+
+// brightness_get da classe de LEDs: a cópia local, que também reflete os arquivos led e fade
+static enum led_brightness smartlamp_led_cdev_get(struct led_classdev *cdev) {
+    struct smartlamp *sl = container_of(cdev, struct smartlamp, led_cdev);
+    enum led_brightness value = cdev->brightness;
+    unsigned long flags;
+
+    spin_lock_irqsave(&sl->cache_lock, flags);
+    if (sl->cache[SMARTLAMP_CH_LED].valid)
+        value = sl->cache[SMARTLAMP_CH_LED].value;
+    spin_unlock_irqrestore(&sl->cache_lock, flags);
+    return value;
+}
+
+// Envia o pedido de LED mais recente; os intermediários nunca chegam ao dispositivo
+static void smartlamp_led_work(struct work_struct *work) {
+    struct smartlamp *sl = container_of(work, struct smartlamp, led_work);
+    unsigned long flags;
+    int level, ret;
+    u64 gen;
+
+    for (;;) {
+        spin_lock_irqsave(&sl->led_req_lock, flags);
+        level = sl->led_req;
+        gen = sl->led_req_gen;
+        sl->led_req = -1;
+        spin_unlock_irqrestore(&sl->led_req_lock, flags);
+
+        if (level < 0)
+            break;
+
+        ret = smartlamp_set_led(sl, level);
+        if (ret)
+            dev_err(&sl->interface->dev, "Falha ao setar o LED para %d, codigo %d.\n", level, ret);
+
+        spin_lock_irqsave(&sl->led_req_lock, flags);
+        sl->led_done_gen = gen;
+        sl->led_err = ret;
+        spin_unlock_irqrestore(&sl->led_req_lock, flags);
+        wake_up_all(&sl->led_wait);
+    }
+}
+
+// Espera todos os pedidos de LED feitos até agora chegarem ao dispositivo. Retorna o resultado do último
+static int smartlamp_led_flush(struct smartlamp *sl) {
+    unsigned long flags;
+    u64 gen;
+    int ret;
+
+    spin_lock_irqsave(&sl->led_req_lock, flags);
+    gen = sl->led_req_gen;
+    spin_unlock_irqrestore(&sl->led_req_lock, flags);
+
+    ret = wait_event_killable(sl->led_wait, smartlamp_led_done(sl, gen) || READ_ONCE(sl->disconnected));
+    if (ret)
+        return ret;
+    if (!smartlamp_led_done(sl, gen))
+        return -ENODEV;
+
+    spin_lock_irqsave(&sl->led_req_lock, flags);
+    ret = sl->led_err;
+    spin_unlock_irqrestore(&sl->led_req_lock, flags);
+    return ret;
+}
+
+// Liga (hz > 0) ou desliga o envio contínuo de um canal pelo firmware. O firmware responde com a taxa
+// que conseguiu aplicar, que fica em stream_hz. Chamado com stream_lock adquirido
+static int smartlamp_stream_start(struct smartlamp *sl, enum smartlamp_channel ch, unsigned int hz) {
+    char cmd[MAX_RECV_LINE];
+    int ret, resp;
+
+    snprintf(cmd, sizeof(cmd), "STREAM_START %s", smartlamp_channels[ch].cmd + strlen("GET_"));
+    ret = usb_send_cmd(sl, cmd, hz, &resp);
+    if (ret)
+        return ret;
+    if (resp < 0)
+        return -EINVAL;
+
+    WRITE_ONCE(sl->stream_hz[ch], resp);
+    return 0;
+}
+
+// Escolhe o filtro do LDR no firmware. Chamado com stream_lock adquirido
+static int smartlamp_ldr_filter_set(struct smartlamp *sl, enum smartlamp_ldr_filter filter, unsigned int window) {
+    int ret, resp;
+
+    ret = usb_send_cmd(sl, smartlamp_ldr_filters[filter].cmd, window, &resp);
+    if (ret)
+        return ret;
+    if (resp < 0)
+        return -EINVAL;
+
+    sl->ldr_filter = filter;
+    sl->ldr_window = resp;
+    return 0;
+}
+
+// O firmware reiniciado não lembra dos fluxos nem do filtro do LDR: religa os fluxos configurados e
+// reenvia o filtro, se não for o padrão. Sem nenhum fluxo configurado, encerra os que uma carga anterior
+// do driver tenha deixado ligados
+static void smartlamp_stream_restore(struct smartlamp *sl) {
+    bool any = false;
+    int ch, resp;
+
+    mutex_lock(&sl->stream_lock);
+    if ((sl->ldr_filter != SMARTLAMP_LDR_FILTER_AVG || sl->ldr_window != SMARTLAMP_LDR_WINDOW_DEFAULT) &&
+        smartlamp_ldr_filter_set(sl, sl->ldr_filter, sl->ldr_window))
+        dev_err(&sl->interface->dev, "Falha ao restaurar o filtro do LDR.\n");
+    for (ch = 0; ch < SMARTLAMP_NCHANNELS; ++ch) {
+        if (!sl->stream_hz[ch])
+            continue;
+        any = true;
+        if (smartlamp_stream_start(sl, ch, sl->stream_hz[ch]))
+            dev_err(&sl->interface->dev, "Falha ao religar o envio contínuo de %s.\n", smartlamp_channels[ch].name);
+    }
+    if (!any)
+        usb_send_cmd(sl, "STREAM_STOP", -1, &resp);
+    mutex_unlock(&sl->stream_lock);
+}
+
+// Encontra a velocidade em que o firmware está e negocia smartlamp_baud (limitada pela ponte). O firmware começa em
+// SMARTLAMP_BAUD_BOOT, mas pode ter ficado na velocidade alta de uma carga anterior do driver. Cada teste
+// vai em texto, que o firmware entende em qualquer protocolo; se a velocidade nova não responder, a ponte
+// volta para SMARTLAMP_BAUD_BOOT (o firmware também volta sozinho se não receber nenhum comando válido).
+// cmd_sem fica em escrita do início ao fim: nenhum outro comando (amostragem, sysfs) sai ou é respondido
+// enquanto a ponte troca de velocidade
+static void smartlamp_link_setup(struct smartlamp *sl) {
+    unsigned int baud = min(smartlamp_baud, sl->ops->max_baud);
+    struct smartlamp_reply reply;
+    unsigned long flags;
+    int ret;
+
+    down_write(&sl->cmd_sem);
+
+    spin_lock_irqsave(&sl->resp_lock, flags);
+    sl->framer.binary = false;
+    smartlamp_framer_reset(&sl->framer);
+    WRITE_ONCE(sl->proto, SMARTLAMP_PROTO_TEXT);
+    spin_unlock_irqrestore(&sl->resp_lock, flags);
+
+    ret = smartlamp_set_line(sl, SMARTLAMP_BAUD_BOOT);
+    if (!ret)
+        ret = __usb_send_cmd_locked(sl, "GET_LDR", -1, -1, &reply, SMARTLAMP_PROTO_TEXT);
+    if (ret && ret != -ENODEV && baud != SMARTLAMP_BAUD_BOOT) {
+        ret = smartlamp_set_line(sl, baud);
+        if (!ret)
+            ret = __usb_send_cmd_locked(sl, "GET_LDR", -1, -1, &reply, SMARTLAMP_PROTO_TEXT);
+    }
+    if (ret) {
+        dev_err(&sl->interface->dev, "Firmware não responde em nenhuma velocidade.\n");
+        smartlamp_set_line(sl, SMARTLAMP_BAUD_BOOT);
+        goto out;
+    }
+
+    if (sl->baud != SMARTLAMP_BAUD_BOOT || baud == SMARTLAMP_BAUD_BOOT)
+        goto out;
+
+    // Um firmware antigo responde "ERR Unknown command." e fica em SMARTLAMP_BAUD_BOOT
+    ret = __usb_send_cmd_locked(sl, "BAUD", -1, baud, &reply, SMARTLAMP_PROTO_TEXT);
+    if (ret || sl->baud == SMARTLAMP_BAUD_BOOT)
+        goto out;
+
+    usleep_range(1000, 2000);               // O firmware troca de velocidade depois de esvaziar a transmissão
+    ret = __usb_send_cmd_locked(sl, "GET_LDR", -1, -1, &reply, SMARTLAMP_PROTO_TEXT);
+    if (ret) {
+        dev_err(&sl->interface->dev, "Firmware não responde a %u baud, voltando para %u.\n",
+                baud, SMARTLAMP_BAUD_BOOT);
+        smartlamp_set_line(sl, SMARTLAMP_BAUD_BOOT);
+    }
+
+out:
+    up_write(&sl->cmd_sem);
+}
+
+// Sincroniza a cópia local do LED com o dispositivo: no probe, lê a intensidade atual; quando o firmware
+// reinicia (e volta ao valor padrão), reenvia a última intensidade definida pelo driver
+static void smartlamp_led_sync_work(struct work_struct *work) {
+    struct smartlamp *sl = container_of(work, struct smartlamp, led_sync_work);
+    struct smartlamp_reply reply;
+    unsigned long flags;
+    bool valid;
+    int level, resp, ret;
+
+    smartlamp_link_setup(sl);
+
+    // Negocia o protocolo, do mais compacto ao mais simples. O firmware pode ter sido trocado, então a
+    // negociação é refeita a cada reinício. Um firmware antigo responde "ERR Unknown command." aos dois testes.
+    // "RES BINARY 1" troca o protocolo no próprio callback de leitura (os quadros seguem imediatamente)
+    ret = -EOPNOTSUPP;
+    if (smartlamp_binary)
+        ret = __usb_send_cmd(sl, "BINARY", -1, 1, &reply, SMARTLAMP_PROTO_TEXT);
+    if (ret && smartlamp_tagged) {
+        ret = __usb_send_cmd(sl, "GET_LDR", -1, -1, &reply, SMARTLAMP_PROTO_TAGGED);
+        if (!ret)
+            WRITE_ONCE(sl->proto, SMARTLAMP_PROTO_TAGGED);
+    }
+    dev_info(&sl->interface->dev, "Protocolo: %s.\n", smartlamp_proto_names[READ_ONCE(sl->proto)]);
+
+    smartlamp_stream_restore(sl);
+
+    mutex_lock(&sl->led_lock);
+
+    spin_lock_irqsave(&sl->cache_lock, flags);
+    valid = sl->cache[SMARTLAMP_CH_LED].valid;
+    level = sl->cache[SMARTLAMP_CH_LED].value;
+    spin_unlock_irqrestore(&sl->cache_lock, flags);
+
+    if (!valid)
+        smartlamp_sample(sl, SMARTLAMP_CH_LED, &level);
+    else if (usb_send_cmd(sl, "SET_LED", level, &resp) || resp != 1)
+        dev_err(&sl->interface->dev, "Falha ao restaurar o LED para %d.\n", level);
+
+    mutex_unlock(&sl->led_lock);
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/{led, ldr} é escrito (e.g., echo "100" | sudo tee -a /sys/class/smartlamp/lamp0/led)
+static ssize_t attr_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    long ret, value;
+    const char *attr_name = attr->attr.name;
+
+    // Converte o valor recebido para long
+    ret = kstrtol(buff, 10, &value);
+    if (ret) {
+        dev_alert(dev, "valor de %s invalido.\n", attr_name);
+        return -EACCES;
+    }
+
+    dev_dbg(dev, "Setando %s para %ld ...\n", attr_name, value);
+
+    // Retorna sem esperar o dispositivo: fsync() em /dev/smartlampN confirma o envio
+    if (strcmp(attr_name, "led") == 0) {
+        if (value < 0 || value > SMARTLAMP_LED_MAX)
+            return -EINVAL;
+        smartlamp_led_request(sl, value);
+    }
+
+    return strlen(buff);
+}
+
+
+static int rtt_cmp(const void *a, const void *b) {
+    u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/rtt_{p50,p99}_us é lido
+// Retorna o percentil do tempo de resposta (em microssegundos) dos últimos comandos bem-sucedidos
+static ssize_t rtt_show(struct device *dev, struct device_attribute *attr, char *buff) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    unsigned int percentile = (attr == &dev_attr_rtt_p99_us) ? 99 : 50;
+    unsigned long flags;
+    unsigned int count;
+    u32 *sorted;
+    u32 value;
+
+    sorted = kmalloc_array(SMARTLAMP_RTT_SAMPLES, sizeof(*sorted), GFP_KERNEL);
+    if (!sorted)
+        return -ENOMEM;
+
+    spin_lock_irqsave(&sl->rtt_lock, flags);
+    count = sl->rtt_count;
+    memcpy(sorted, sl->rtt_samples, count * sizeof(*sorted));
+    spin_unlock_irqrestore(&sl->rtt_lock, flags);
+
+    value = 0;
+    if (count) {
+        sort(sorted, count, sizeof(*sorted), rtt_cmp, NULL);
+        value = sorted[DIV_ROUND_UP(count * percentile, 100) - 1];
+    }
+    kfree(sorted);
+
+    sprintf(buff, "%u\n", value);
+    return strlen(buff);
+}
+
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/{ldr, temp, hum}_interval_ms é lido
+static ssize_t interval_show(struct device *dev, struct device_attribute *attr, char *buff) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    int ch = smartlamp_attr_channel(attr->attr.name);
+
+    sprintf(buff, "%u\n", READ_ONCE(sl->interval_ms[ch]));
+    return strlen(buff);
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/{ldr, temp, hum}_interval_ms é escrito
+// Muda o intervalo de amostragem do canal (0 desativa a amostragem e o cache do canal)
+static ssize_t interval_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    int ch = smartlamp_attr_channel(attr->attr.name);
+    unsigned int value;
+    int ret;
+
+    ret = kstrtouint(buff, 10, &value);
+    if (ret)
+        return ret;
+
+    if (value && value < smartlamp_channels[ch].min_interval_ms)
+        return -EINVAL;
+
+    WRITE_ONCE(sl->interval_ms[ch], value);
+    sl->next_sample[ch] = ktime_get();
+    mod_delayed_work(smartlamp_wq, &sl->sample_work, 0);
+
+    return count;
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/fade é escrito: "<intensidade> <ms>"
+// (e.g., echo "80 500" | sudo tee /sys/class/smartlamp/lamp0/fade). Pedidos ainda não enviados em led são
+// aplicados antes, para o fade partir do último valor escrito
+static ssize_t fade_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    int level, ms, ret;
+
+    if (sscanf(buff, "%d %d", &level, &ms) != 2)
+        return -EINVAL;
+
+    ret = smartlamp_led_flush(sl);
+    if (!ret)
+        ret = smartlamp_led_fade(sl, level, ms);
+
+    return ret ? ret : count;
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/{ldr, temp, hum}_stream_hz é lido
+static ssize_t stream_hz_show(struct device *dev, struct device_attribute *attr, char *buff) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    int ch = smartlamp_attr_channel(attr->attr.name);
+
+    return sysfs_emit(buff, "%u\n", READ_ONCE(sl->stream_hz[ch]));
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/{ldr, temp, hum}_stream_hz é escrito
+// O firmware passa a enviar o canal sozinho, na taxa pedida, sem um comando por amostra (0: desliga)
+static ssize_t stream_hz_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    int ch = smartlamp_attr_channel(attr->attr.name);
+    unsigned int value;
+    int ret;
+
+    ret = kstrtouint(buff, 10, &value);
+    if (ret)
+        return ret;
+
+    if (value > smartlamp_channels[ch].max_stream_hz)
+        return -EINVAL;
+
+    mutex_lock(&sl->stream_lock);
+    ret = smartlamp_stream_start(sl, ch, value);
+    mutex_unlock(&sl->stream_lock);
+
+    return ret ? ret : count;
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/ldr_raw é lido: a leitura filtrada do ADC
+// (0 a 4095), com mais resolução que a porcentagem de ldr
+static ssize_t ldr_raw_show(struct device *dev, struct device_attribute *attr, char *buff) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    int ret, value;
+
+    ret = usb_send_cmd(sl, "GET_LDR_RAW", -1, &value);
+    if (ret)
+        return ret;
+
+    return sysfs_emit(buff, "%d\n", value);
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/ldr_filter é lido: filtro e janela (e.g., "avg 8")
+static ssize_t ldr_filter_show(struct device *dev, struct device_attribute *attr, char *buff) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    ssize_t len;
+
+    mutex_lock(&sl->stream_lock);
+    len = sysfs_emit(buff, "%s %u\n", smartlamp_ldr_filters[sl->ldr_filter].name, sl->ldr_window);
+    mutex_unlock(&sl->stream_lock);
+    return len;
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/ldr_filter é escrito: "<none|avg|median> <janela>"
+static ssize_t ldr_filter_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    unsigned int window;
+    char name[8];
+    int i, ret;
+
+    if (sscanf(buff, "%7s %u", name, &window) != 2 || window < 1 || window > SMARTLAMP_LDR_WINDOW_MAX)
+        return -EINVAL;
+
+    for (i = 0; i < ARRAY_SIZE(smartlamp_ldr_filters); ++i) {
+        if (strcmp(name, smartlamp_ldr_filters[i].name) == 0)
+            break;
+    }
+    if (i == ARRAY_SIZE(smartlamp_ldr_filters))
+        return -EINVAL;
+
+    mutex_lock(&sl->stream_lock);
+    ret = smartlamp_ldr_filter_set(sl, i, window);
+    mutex_unlock(&sl->stream_lock);
+
+    return ret ? ret : count;
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/protocol é lido: text, tagged ou binary
+static ssize_t protocol_show(struct device *dev, struct device_attribute *attr, char *buff) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+
+    return sysfs_emit(buff, "%s\n", smartlamp_proto_names[READ_ONCE(sl->proto)]);
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/baud é lido: velocidade atual da linha serial
+static ssize_t baud_show(struct device *dev, struct device_attribute *attr, char *buff) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+
+    return sysfs_emit(buff, "%u\n", READ_ONCE(sl->baud));
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/max_age_ms é lido
+static ssize_t max_age_ms_show(struct device *dev, struct device_attribute *attr, char *buff) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+
+    sprintf(buff, "%u\n", READ_ONCE(sl->max_age_ms));
+    return strlen(buff);
+}
+
+// Executado quando o arquivo /sys/class/smartlamp/lampN/max_age_ms é escrito
+// Valores em cache mais velhos que max_age_ms forçam uma leitura do dispositivo (0: sem limite)
+static ssize_t max_age_ms_store(struct device *dev, struct device_attribute *attr, const char *buff, size_t count) {
+    struct smartlamp *sl = dev_get_drvdata(dev);
+    unsigned int value;
+    int ret;
+
+    ret = kstrtouint(buff, 10, &value);
+    if (ret)
+        return ret;
+
+    WRITE_ONCE(sl->max_age_ms, value);
+    return count;
+}
+
+
+// Executado quando /dev/smartlampN é aberto: cria a fila de registros do novo leitor
+static int smartlamp_open(struct inode *inode, struct file *file) {
+    struct smartlamp_reader *reader;
+    struct smartlamp *sl;
+    unsigned long flags;
+    int ret;
+
+    reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+    if (!reader)
+        return -ENOMEM;
+
+    ret = kfifo_alloc(&reader->fifo, SMARTLAMP_READER_RECORDS, GFP_KERNEL);
+    if (ret) {
+        kfree(reader);
+        return ret;
+    }
+    mutex_init(&reader->read_lock);
+
+    mutex_lock(&smartlamp_idr_lock);
+    sl = idr_find(&smartlamp_idr, iminor(inode));
+    if (sl)
+        kref_get(&sl->kref);                // O dispositivo não é liberado enquanto o arquivo estiver aberto
+    mutex_unlock(&smartlamp_idr_lock);
+
+    if (!sl) {
+        kfifo_free(&reader->fifo);
+        kfree(reader);
+        return -ENODEV;
+    }
+
+    reader->sl = sl;
+    spin_lock_irqsave(&sl->readers_lock, flags);
+    list_add_tail(&reader->node, &sl->readers);
+    spin_unlock_irqrestore(&sl->readers_lock, flags);
+
+    file->private_data = reader;
+    return stream_open(inode, file);
+}
+
+// Executado quando o último descritor de /dev/smartlampN é fechado
+static int smartlamp_release(struct inode *inode, struct file *file) {
+    struct smartlamp_reader *reader = file->private_data;
+    struct smartlamp *sl = reader->sl;
+    unsigned long flags;
+
+    spin_lock_irqsave(&sl->readers_lock, flags);
+    list_del(&reader->node);
+    spin_unlock_irqrestore(&sl->readers_lock, flags);
+
+    if (reader->lost)
+        dev_info(&sl->interface->dev, "Leitor descartou %lu registros.\n", reader->lost);
+
+    kfifo_free(&reader->fifo);
+    kfree(reader);
+    kref_put(&sl->kref, smartlamp_delete);
+    return 0;
+}
+
+// Executado quando /dev/smartlampN é lido: copia registros inteiros (struct smartlamp_record).
+// Bloqueia até chegar uma amostra, exceto com O_NONBLOCK. Retorna 0 (fim de arquivo) após a desconexão
+static ssize_t smartlamp_read(struct file *file, char __user *buf, size_t count, loff_t *ppos) {
+    struct smartlamp_reader *reader = file->private_data;
+    struct smartlamp *sl = reader->sl;
+    unsigned int copied;
+    int ret;
+
+    if (count < sizeof(struct smartlamp_record))
+        return -EINVAL;
+
+    ret = mutex_lock_interruptible(&reader->read_lock);
+    if (ret)
+        return ret;
+
+    while (kfifo_is_empty(&reader->fifo)) {
+        if (READ_ONCE(sl->disconnected)) {
+            mutex_unlock(&reader->read_lock);
+            return 0;
+        }
+        if (file->f_flags & O_NONBLOCK) {
+            mutex_unlock(&reader->read_lock);
+            return -EAGAIN;
+        }
+
+        ret = wait_event_interruptible(sl->read_wait,
+                                       !kfifo_is_empty(&reader->fifo) || READ_ONCE(sl->disconnected));
+        if (ret) {
+            mutex_unlock(&reader->read_lock);
+            return ret;
+        }
+    }
+
+    ret = kfifo_to_user(&reader->fifo, buf, count, &copied);
+    mutex_unlock(&reader->read_lock);
+
+    return ret ? ret : copied;
+}
+
+// Executado por poll/select/epoll em /dev/smartlampN
+static __poll_t smartlamp_poll(struct file *file, poll_table *wait) {
+    struct smartlamp_reader *reader = file->private_data;
+    struct smartlamp *sl = reader->sl;
+    __poll_t mask = 0;
+
+    poll_wait(file, &sl->read_wait, wait);
+
+    if (!kfifo_is_empty(&reader->fifo))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (READ_ONCE(sl->disconnected))
+        mask |= EPOLLHUP | EPOLLERR;
+
+    return mask;
+}
+
+// fsync() em /dev/smartlampN: espera as escritas em led (que retornam sem esperar o dispositivo) chegarem
+// ao firmware e retorna o erro do último SET_LED, se houver
+static int smartlamp_fsync(struct file *file, loff_t start, loff_t end, int datasync) {
+    struct smartlamp_reader *reader = file->private_data;
+
+    return smartlamp_led_flush(reader->sl);
+}
+
+// Executado por mmap() em /dev/smartlampN: mapeia a página de controle e os registros do anel.
+// O mapeamento é compartilhado entre todos os arquivos abertos do dispositivo; deve haver um único consumidor
+static int smartlamp_mmap(struct file *file, struct vm_area_struct *vma) {
+    struct smartlamp_reader *reader = file->private_data;
+    struct smartlamp *sl = reader->sl;
+
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != (1 + SMARTLAMP_RING_PAGES) * PAGE_SIZE)
+        return -EINVAL;
+    if (!(vma->vm_flags & VM_SHARED))
+        return -EINVAL;
+
+    // O anel vive até a última referência ao dispositivo; o arquivo mapeado mantém uma
+    return remap_vmalloc_range(vma, sl->ring, 0);
+}
+
+// Testes KUnit (make kunit): incluídos aqui para alcançar as funções estáticas do framer
+#if defined(SMARTLAMP_KUNIT) && IS_ENABLED(CONFIG_KUNIT)
+#include "smartlamp_kunit.c"
+#endif
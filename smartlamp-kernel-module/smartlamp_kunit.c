@@ -0,0 +1,221 @@
+// Testes KUnit da remontagem de linhas e quadros recebidos da USB. Incluído no fim de smartlamp.c
+// (make kunit) para alcançar as funções estáticas; executados ao carregar o módulo em um kernel com
+// CONFIG_KUNIT. Resultado em /sys/kernel/debug/kunit/smartlamp_framer/results
+
+#include <kunit/test.h>
+
+#define SMARTLAMP_TEST_MAX_EMITS 8                 // Linhas (ou quadros) guardadas por teste
+
+// Saída do framer: linhas e quadros emitidos, na ordem
+struct smartlamp_test_out {
+    char lines[SMARTLAMP_TEST_MAX_EMITS][MAX_RECV_LINE];
+    int  nlines;
+    u8   frames[SMARTLAMP_TEST_MAX_EMITS][MAX_RECV_LINE];
+    int  frame_len[SMARTLAMP_TEST_MAX_EMITS];
+    int  nframes;
+    unsigned long count;                           // Total emitido (o microbenchmark não guarda as linhas)
+};
+
+static void smartlamp_test_emit(void *ctx, const char *line) {
+    struct smartlamp_test_out *out = ctx;
+
+    out->count++;
+    if (out->nlines < SMARTLAMP_TEST_MAX_EMITS)
+        strscpy(out->lines[out->nlines++], line, MAX_RECV_LINE);
+}
+
+static void smartlamp_test_emit_frame(void *ctx, const u8 *frame, int len) {
+    struct smartlamp_test_out *out = ctx;
+
+    out->count++;
+    if (out->nframes < SMARTLAMP_TEST_MAX_EMITS) {
+        memcpy(out->frames[out->nframes], frame, len);
+        out->frame_len[out->nframes++] = len;
+    }
+}
+
+static void smartlamp_test_feed(struct smartlamp_framer *fr, struct smartlamp_test_out *out, const char *data, int len) {
+    smartlamp_framer_feed(fr, data, len, smartlamp_test_emit, smartlamp_test_emit_frame, out);
+}
+
+static int smartlamp_test_init(struct kunit *test) {
+    test->priv = kunit_kzalloc(test, sizeof(struct smartlamp_test_out), GFP_KERNEL);
+    return test->priv ? 0 : -ENOMEM;
+}
+
+// Uma resposta dividida em dois pacotes é emitida uma vez, inteira
+static void smartlamp_test_split(struct kunit *test) {
+    struct smartlamp_test_out *out = test->priv;
+    struct smartlamp_framer fr = { };
+
+    smartlamp_test_feed(&fr, out, "RES GET_L", 9);
+    KUNIT_EXPECT_EQ(test, out->nlines, 0);
+    smartlamp_test_feed(&fr, out, "DR 42\r\n", 7);
+
+    KUNIT_ASSERT_EQ(test, out->nlines, 1);
+    KUNIT_EXPECT_STREQ(test, out->lines[0], "RES GET_LDR 42");
+}
+
+// A mesma resposta chegando um byte por pacote
+static void smartlamp_test_split_bytes(struct kunit *test) {
+    struct smartlamp_test_out *out = test->priv;
+    struct smartlamp_framer fr = { };
+    const char *resp = "RES GET_TEMP 23.4 850\n";
+    int i;
+
+    for (i = 0; resp[i]; ++i)
+        smartlamp_test_feed(&fr, out, resp + i, 1);
+
+    KUNIT_ASSERT_EQ(test, out->nlines, 1);
+    KUNIT_EXPECT_STREQ(test, out->lines[0], "RES GET_TEMP 23.4 850");
+}
+
+// Várias respostas no mesmo pacote, a última incompleta até o próximo
+static void smartlamp_test_merged(struct kunit *test) {
+    struct smartlamp_test_out *out = test->priv;
+    struct smartlamp_framer fr = { };
+    const char *pkt = "RES GET_LED 10\nRES GET_LDR 20\r\nRES GET_H";
+
+    smartlamp_test_feed(&fr, out, pkt, strlen(pkt));
+    KUNIT_ASSERT_EQ(test, out->nlines, 2);
+    smartlamp_test_feed(&fr, out, "UM 61.0 0\n", 10);
+
+    KUNIT_ASSERT_EQ(test, out->nlines, 3);
+    KUNIT_EXPECT_STREQ(test, out->lines[0], "RES GET_LED 10");
+    KUNIT_EXPECT_STREQ(test, out->lines[1], "RES GET_LDR 20");
+    KUNIT_EXPECT_STREQ(test, out->lines[2], "RES GET_HUM 61.0 0");
+}
+
+// Lixo (bytes não imprimíveis, linhas vazias) descarta só a linha em que aparece
+static void smartlamp_test_garbage(struct kunit *test) {
+    struct smartlamp_test_out *out = test->priv;
+    struct smartlamp_framer fr = { };
+    const char pkt[] = "\n\r\nRES GET\x01_LDR 1\nab\xffz\nRES GET_LDR 2\n";
+
+    smartlamp_test_feed(&fr, out, pkt, sizeof(pkt) - 1);
+
+    KUNIT_ASSERT_EQ(test, out->nlines, 1);
+    KUNIT_EXPECT_STREQ(test, out->lines[0], "RES GET_LDR 2");
+    KUNIT_EXPECT_EQ(test, fr.dropped, 2UL);
+}
+
+// Uma linha maior que MAX_RECV_LINE é descartada inteira, mesmo dividida em vários pacotes
+static void smartlamp_test_overlong(struct kunit *test) {
+    struct smartlamp_test_out *out = test->priv;
+    struct smartlamp_framer fr = { };
+    char pkt[MAX_RECV_LINE];
+
+    memset(pkt, 'A', sizeof(pkt));
+    smartlamp_test_feed(&fr, out, pkt, sizeof(pkt));
+    smartlamp_test_feed(&fr, out, pkt, sizeof(pkt));
+    smartlamp_test_feed(&fr, out, "\nRES GET_LED 5\n", 15);
+
+    KUNIT_ASSERT_EQ(test, out->nlines, 1);
+    KUNIT_EXPECT_STREQ(test, out->lines[0], "RES GET_LED 5");
+    KUNIT_EXPECT_EQ(test, fr.dropped, 1UL);
+}
+
+// Modo binário: um quadro COBS dividido entre pacotes é emitido inteiro e decodifica para o original
+static void smartlamp_test_binary(struct kunit *test) {
+    struct smartlamp_test_out *out = test->priv;
+    struct smartlamp_framer fr = { .binary = true };
+    const u8 payload[] = { 0x02, 0x00, 0x2a, 0x00, 0x00, 0x12, 0x34 };
+    u8 enc[sizeof(payload) + 2], dec[SMARTLAMP_FRAME_MAX];
+    int n;
+
+    n = smartlamp_cobs_encode(payload, sizeof(payload), enc);
+    KUNIT_ASSERT_EQ(test, enc[n - 1], 0);
+    KUNIT_EXPECT_NULL(test, memchr(enc, 0, n - 1));
+
+    smartlamp_test_feed(&fr, out, (const char *)enc, 3);
+    KUNIT_EXPECT_EQ(test, out->nframes, 0);
+    smartlamp_test_feed(&fr, out, (const char *)enc + 3, n - 3);
+
+    KUNIT_ASSERT_EQ(test, out->nframes, 1);
+    KUNIT_EXPECT_EQ(test, out->frame_len[0], n - 1);
+    n = smartlamp_cobs_decode(out->frames[0], out->frame_len[0], dec, sizeof(dec));
+    KUNIT_ASSERT_EQ(test, n, (int)sizeof(payload));
+    KUNIT_EXPECT_MEMEQ(test, dec, payload, sizeof(payload));
+}
+
+// Modo binário: o firmware reiniciado envia SMARTLAMP_HELLO em texto, reconhecido no meio de um quadro.
+// SMARTLAMP_HELLO seguido de outro byte (aqui o delimitador 0) não é a linha e recomeça o reconhecimento
+static void smartlamp_test_binary_hello(struct kunit *test) {
+    struct smartlamp_test_out *out = test->priv;
+    struct smartlamp_framer fr = { .binary = true };
+    const char pkt[] = "\x03\x01" SMARTLAMP_HELLO "\n";
+    const char partial[] = SMARTLAMP_HELLO "\0\x01";
+
+    smartlamp_test_feed(&fr, out, partial, sizeof(partial) - 1);
+    KUNIT_EXPECT_EQ(test, out->nlines, 0);
+    KUNIT_EXPECT_EQ(test, fr.hello_pos, 0U);
+    KUNIT_EXPECT_TRUE(test, fr.binary);
+
+    smartlamp_test_feed(&fr, out, pkt, sizeof(pkt) - 1);
+
+    KUNIT_ASSERT_EQ(test, out->nlines, 1);
+    KUNIT_EXPECT_STREQ(test, out->lines[0], SMARTLAMP_HELLO);
+    KUNIT_EXPECT_FALSE(test, fr.binary);
+    KUNIT_EXPECT_EQ(test, out->nframes, 1);                // Só o quadro de partial
+}
+
+// Quadros COBS inválidos ou maiores que o destino são recusados
+static void smartlamp_test_cobs_invalid(struct kunit *test) {
+    const u8 short_block[] = { 0x05, 0x01, 0x02 };         // Bloco anuncia 4 bytes, só há 2
+    const u8 zero_code[] = { 0x02, 0x01, 0x00, 0x01 };     // 0 dentro do quadro
+    const u8 long_frame[] = { 0x05, 0x01, 0x02, 0x03, 0x04 };
+    u8 dec[SMARTLAMP_FRAME_MAX];
+
+    KUNIT_EXPECT_EQ(test, smartlamp_cobs_decode(short_block, sizeof(short_block), dec, sizeof(dec)), -1);
+    KUNIT_EXPECT_EQ(test, smartlamp_cobs_decode(zero_code, sizeof(zero_code), dec, sizeof(dec)), -1);
+    KUNIT_EXPECT_EQ(test, smartlamp_cobs_decode(long_frame, sizeof(long_frame), dec, 3), -1);
+    KUNIT_EXPECT_EQ(test, smartlamp_cobs_decode(long_frame, sizeof(long_frame), dec, 4), 4);
+}
+
+#define SMARTLAMP_BENCH_BYTES (256 * 1024)         // Dados alimentados ao framer no microbenchmark
+#define SMARTLAMP_BENCH_PACKET 64                  // Tamanho do pacote bulk simulado
+
+// Microbenchmark: vazão do framer com respostas típicas em pacotes de 64 bytes. Só informa o resultado
+static void smartlamp_test_bench(struct kunit *test) {
+    struct smartlamp_test_out *out = test->priv;
+    struct smartlamp_framer fr = { };
+    const char *resp = "RES GET_LDR 42\n";
+    int resp_len = strlen(resp), i, n = 0;
+    ktime_t start, elapsed;
+    char *buf;
+
+    buf = kunit_kmalloc(test, SMARTLAMP_BENCH_BYTES, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, buf);
+    for (i = 0; i + resp_len <= SMARTLAMP_BENCH_BYTES; i += resp_len, ++n)
+        memcpy(buf + i, resp, resp_len);
+
+    start = ktime_get();
+    for (i = 0; i < n * resp_len; i += SMARTLAMP_BENCH_PACKET)
+        smartlamp_test_feed(&fr, out, buf + i, min(SMARTLAMP_BENCH_PACKET, n * resp_len - i));
+    elapsed = ktime_sub(ktime_get(), start);
+
+    KUNIT_EXPECT_EQ(test, out->count, (unsigned long)n);
+    kunit_info(test, "%d linhas (%d bytes) em %lld ns: %lld MB/s\n", n, n * resp_len, ktime_to_ns(elapsed),
+               div64_s64((s64)n * resp_len * 1000, max_t(s64, ktime_to_ns(elapsed), 1)));
+}
+
+static struct kunit_case smartlamp_framer_cases[] = {
+    KUNIT_CASE(smartlamp_test_split),
+    KUNIT_CASE(smartlamp_test_split_bytes),
+    KUNIT_CASE(smartlamp_test_merged),
+    KUNIT_CASE(smartlamp_test_garbage),
+    KUNIT_CASE(smartlamp_test_overlong),
+    KUNIT_CASE(smartlamp_test_binary),
+    KUNIT_CASE(smartlamp_test_binary_hello),
+    KUNIT_CASE(smartlamp_test_cobs_invalid),
+    KUNIT_CASE_SLOW(smartlamp_test_bench),
+    {}
+};
+
+static struct kunit_suite smartlamp_framer_suite = {
+    .name = "smartlamp_framer",
+    .init = smartlamp_test_init,
+    .test_cases = smartlamp_framer_cases,
+};
+
+kunit_test_suite(smartlamp_framer_suite);
@@ -0,0 +1,130 @@
+// Tracepoints do caminho de um comando: envio, fim da URB de saída, primeiro byte recebido, resposta,
+// reenvio e desistência. Ativados em /sys/kernel/tracing/events/smartlamp (e.g., perf trace -e 'smartlamp:*')
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM smartlamp
+
+#if !defined(_SMARTLAMP_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _SMARTLAMP_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#define SMARTLAMP_TRACE_CMD_LEN 24                 // Nome do comando guardado em cada evento
+
+TRACE_EVENT(smartlamp_cmd_submit,
+    TP_PROTO(int index, u16 seq, int proto, const char *cmd, int param),
+    TP_ARGS(index, seq, proto, cmd, param),
+    TP_STRUCT__entry(
+        __field(int, index)
+        __field(u16, seq)
+        __field(int, proto)
+        __array(char, cmd, SMARTLAMP_TRACE_CMD_LEN)
+        __field(int, param)
+    ),
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->seq = seq;
+        __entry->proto = proto;
+        strscpy(__entry->cmd, cmd, SMARTLAMP_TRACE_CMD_LEN);
+        __entry->param = param;
+    ),
+    TP_printk("lamp%d seq=%u proto=%d cmd=%s param=%d",
+              __entry->index, __entry->seq, __entry->proto, __entry->cmd, __entry->param)
+);
+
+TRACE_EVENT(smartlamp_out_complete,
+    TP_PROTO(int index, int status, int len),
+    TP_ARGS(index, status, len),
+    TP_STRUCT__entry(
+        __field(int, index)
+        __field(int, status)
+        __field(int, len)
+    ),
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->status = status;
+        __entry->len = len;
+    ),
+    TP_printk("lamp%d status=%d len=%d", __entry->index, __entry->status, __entry->len)
+);
+
+TRACE_EVENT(smartlamp_cmd_first_rx,
+    TP_PROTO(int index, u16 seq, s64 delta_us),
+    TP_ARGS(index, seq, delta_us),
+    TP_STRUCT__entry(
+        __field(int, index)
+        __field(u16, seq)
+        __field(s64, delta_us)
+    ),
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->seq = seq;
+        __entry->delta_us = delta_us;
+    ),
+    TP_printk("lamp%d seq=%u delta_us=%lld", __entry->index, __entry->seq, __entry->delta_us)
+);
+
+TRACE_EVENT(smartlamp_cmd_response,
+    TP_PROTO(int index, u16 seq, int status, int value, s64 delta_us),
+    TP_ARGS(index, seq, status, value, delta_us),
+    TP_STRUCT__entry(
+        __field(int, index)
+        __field(u16, seq)
+        __field(int, status)
+        __field(int, value)
+        __field(s64, delta_us)
+    ),
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->seq = seq;
+        __entry->status = status;
+        __entry->value = value;
+        __entry->delta_us = delta_us;
+    ),
+    TP_printk("lamp%d seq=%u status=%d value=%d delta_us=%lld",
+              __entry->index, __entry->seq, __entry->status, __entry->value, __entry->delta_us)
+);
+
+TRACE_EVENT(smartlamp_cmd_retry,
+    TP_PROTO(int index, u16 seq, int attempt, unsigned int wait_ms),
+    TP_ARGS(index, seq, attempt, wait_ms),
+    TP_STRUCT__entry(
+        __field(int, index)
+        __field(u16, seq)
+        __field(int, attempt)
+        __field(unsigned int, wait_ms)
+    ),
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->seq = seq;
+        __entry->attempt = attempt;
+        __entry->wait_ms = wait_ms;
+    ),
+    TP_printk("lamp%d seq=%u attempt=%d wait_ms=%u",
+              __entry->index, __entry->seq, __entry->attempt, __entry->wait_ms)
+);
+
+TRACE_EVENT(smartlamp_cmd_timeout,
+    TP_PROTO(int index, u16 seq, const char *cmd),
+    TP_ARGS(index, seq, cmd),
+    TP_STRUCT__entry(
+        __field(int, index)
+        __field(u16, seq)
+        __array(char, cmd, SMARTLAMP_TRACE_CMD_LEN)
+    ),
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->seq = seq;
+        strscpy(__entry->cmd, cmd, SMARTLAMP_TRACE_CMD_LEN);
+    ),
+    TP_printk("lamp%d seq=%u cmd=%s", __entry->index, __entry->seq, __entry->cmd)
+);
+
+#endif
+
+// Fora do bloco acima: define_trace.h relê este arquivo para gerar o código dos eventos
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE smartlamp_trace
+#include <trace/define_trace.h>
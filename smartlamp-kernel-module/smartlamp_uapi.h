@@ -0,0 +1,42 @@
+#ifndef _SMARTLAMP_UAPI_H
+#define _SMARTLAMP_UAPI_H
+
+// Definições compartilhadas entre o driver e os programas que usam /dev/smartlampN
+
+#include <linux/types.h>
+
+// Canais de dados do SmartLamp
+enum smartlamp_channel {
+    SMARTLAMP_CH_LED,
+    SMARTLAMP_CH_LDR,
+    SMARTLAMP_CH_TEMP,
+    SMARTLAMP_CH_HUM,
+    SMARTLAMP_NCHANNELS
+};
+
+// Registro retornado por read() em /dev/smartlampN: uma amostra de um canal
+struct smartlamp_record {
+    __u32 channel;                                 // enum smartlamp_channel
+    __s32 value;                                   // Valor lido (temperatura e umidade em décimos: 234 = 23.4)
+    __s64 timestamp_ns;                            // Momento da leitura (CLOCK_MONOTONIC): a chegada do valor, ou
+                                                   // antes, para os canais que o firmware informa a idade (DHT)
+};
+
+// Página de controle do anel mapeado com mmap() em /dev/smartlampN, no estilo do ring buffer do perf.
+// O mapeamento tem uma página de controle seguida de data_size bytes de registros (struct smartlamp_record).
+// data_head e data_tail contam registros desde o início; a posição no anel é o contador módulo data_capacity
+// (que não é necessariamente potência de 2, então use %, não uma máscara).
+// O driver escreve data_head (com barreira de liberação) depois de gravar o registro; o consumidor lê
+// data_head com barreira de aquisição, consome os registros e escreve data_tail com barreira de liberação.
+// Registros que não cabem no anel (data_head - data_tail == data_capacity) são descartados e contados em lost.
+struct smartlamp_ring_page {
+    __u64 data_head;                               // Escrito pelo driver
+    __u64 data_tail;                               // Escrito pelo consumidor
+    __u64 lost;                                    // Registros descartados com o anel cheio
+    __u32 data_offset;                             // Início dos registros a partir do início do mapeamento
+    __u32 data_size;                               // Tamanho da área de registros em bytes
+    __u32 data_capacity;                           // Capacidade do anel em registros
+    __u32 reserved;
+};
+
+#endif
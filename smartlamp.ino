@@ -1,85 +1,914 @@
-#include <DHT.h>
+#include <atomic>
+#include <driver/ledc.h>
+#include <driver/gpio.h>
 
 // Defina os pinos de LED e LDR
 int ledPin = 22;
 int ldrPin = 2;
 int ldrMax = 4000;  // valor máximo calibrado do LDR
+
+// LDR: cada amostra é a média de LDR_OVERSAMPLE conversões e passa por um filtro (média móvel ou mediana
+// das últimas n amostras) escolhido com LDR_FILTER. O pino 2 é do ADC2, que o modo contínuo (DMA) do
+// ESP32 não lê: as conversões são avulsas, feitas pela tarefa de sensores fora do caminho dos comandos
+#define LDR_OVERSAMPLE 4
+#define LDR_WINDOW_MAX 32     // Maior janela do filtro
+#define LDR_FILTER_NONE 0
+#define LDR_FILTER_AVG 1
+#define LDR_FILTER_MEDIAN 2
+#define LDR_FILTER_CFG(mode, n) ((mode) << 8 | (n))
+
+// Filtro atual (LDR_FILTER_CFG): escrito pelos comandos e lido pela tarefa de sensores
+std::atomic<uint16_t> ldrFilterCfg(LDR_FILTER_CFG(LDR_FILTER_AVG, 8));
 int ledValue = 10;  // valor de 0 a 100
+bool ledFading = false;  // Um fade começado por ledFade() pode estar em andamento
+
+// PWM do LED no LEDC, com mais resolução que os 8 bits do analogWrite: os níveis baixos, onde o olho
+// percebe cada passo, ficam suaves. As transições de SET_LED_FADE rodam no hardware de fade do LEDC
+#define LED_CHANNEL 0
+#define LED_PWM_FREQ 5000
+#define LED_PWM_BITS 12
+#define LED_DUTY_MAX ((1 << LED_PWM_BITS) - 1)
+#define LED_FADE_MAX_MS 30000
+
+// Correção de gama: o brilho percebido segue ~p^2.2, aproximado por p²·(400 + p) / 5·10⁶ (exato em 0 e 100)
+constexpr uint16_t gammaDuty(int p) {
+  return (uint64_t)LED_DUTY_MAX * p * p * (400 + p) / 5000000;
+}
+
+#define G10(p) gammaDuty(p), gammaDuty(p + 1), gammaDuty(p + 2), gammaDuty(p + 3), gammaDuty(p + 4), \
+               gammaDuty(p + 5), gammaDuty(p + 6), gammaDuty(p + 7), gammaDuty(p + 8), gammaDuty(p + 9)
+
+// Duty do LEDC para cada intensidade de 0 a 100, calculado na compilação
+constexpr uint16_t gammaTable[101] = {
+  G10(0), G10(10), G10(20), G10(30), G10(40), G10(50), G10(60), G10(70), G10(80), G10(90), gammaDuty(100),
+};
+static_assert(gammaTable[100] == LED_DUTY_MAX, "gammaTable[100] deve ser o duty máximo");
 
-#define DHTTYPE DHT11
+// DHT11 lido pelo periférico RMT, sem a biblioteca DHT (que desliga as interrupções por ~5 ms a cada leitura).
+// O firmware baixa a linha por DHT_START_MS, solta e o RMT mede os pulsos da resposta sozinho: 80 µs
+// em 0 e 80 µs em 1, seguidos de 40 bits (50 µs em 0 e então ~27 µs em 1 para 0 ou ~70 µs para 1)
 #define DHTPIN 4
+#define DHT_RMT_HZ 1000000    // Resolução do RMT: 1 µs
+#define DHT_FILTER_US 2       // Ignora ruídos mais curtos que isso
+#define DHT_IDLE_US 200       // Linha parada por mais que isso: fim da resposta
+#define DHT_SYMBOLS 64        // Símbolos do RMT (pares de pulsos) da resposta: ~43
+#define DHT_START_MS 20       // Sinal de início (mínimo de 18 ms)
+#define DHT_TIMEOUT_MS 10     // A resposta completa dura ~5 ms
+#define DHT_BITS 40
+#define DHT_BIT1_US 48        // Pulso em 1 mais longo que isso é um bit 1
+
+// Protocolo binário: quadros COBS terminados em 0 com código, etiqueta, valores de 16 bits (little endian)
+// e CRC-16/CCITT. Os códigos são os mesmos do driver (SMARTLAMP_OP_*); a resposta usa código | OP_RES
+// e o erro, código | OP_ERR
+#define OP_GET_LED  0x01
+#define OP_SET_LED  0x02
+#define OP_GET_LDR  0x03
+#define OP_GET_TEMP 0x04
+#define OP_GET_HUM  0x05
+#define OP_GET_ALL  0x06
+#define OP_STREAM_START 0x07
+#define OP_STREAM_STOP  0x08
+#define OP_SET_LED_FADE 0x09
+#define OP_GET_LDR_RAW  0x0A
+#define OP_LDR_FILTER   0x0B
+#define OP_RES      0x80
+#define OP_ERR      0x40
+#define ERR_UNKNOWN 1   // Valor do quadro de erro para um código desconhecido (o driver distingue do erro do sensor)
+#define FRAME_MAX   30  // Quadros menores que 31 bytes: o código COBS do início nunca é um caractere imprimível
+#define VALUE_NAN   INT16_MIN  // Sensor com erro em GET_ALL
+
+// Velocidade da serial: começa em BOOT_BAUD e o driver negocia uma maior com "BAUD <n>". Se nenhum comando
+// válido chegar em BAUD_CONFIRM_MS depois da troca, o driver não acompanhou e o firmware volta a BOOT_BAUD
+#define BOOT_BAUD 9600
+#define BAUD_CONFIRM_MS 1000
+uint32_t baudSwitchMs = 0;  // Momento da última troca ainda não confirmada (0: confirmada)
+long serialBaud = BOOT_BAUD;  // Velocidade atual da serial: limita a taxa do envio contínuo
+
+uint8_t rxBuf[64];  // Linha de texto ou quadro binário sendo recebido
+size_t rxLen = 0;
+TaskHandle_t loopTask;  // Tarefa de setup() e loop(), acordada pelo callback de recepção da serial
+
+// Envio contínuo (STREAM_START): o firmware manda as leituras sozinho, sem um comando por amostra.
+// Os índices são os canais do driver (LED, LDR, temperatura e umidade); as amostras vão como respostas
+// comuns ("RES GET_LDR 42" ou quadro com etiqueta STREAM_SEQ), no formato do STREAM_START que as pediu
+#define CH_LDR  1
+#define CH_TEMP 2
+#define CH_HUM  3
+#define NCHANNELS 4
+#define STREAM_SEQ 0xFF       // Etiqueta dos quadros enviados sem comando
+#define STREAM_MAX_HZ 200
+#define STREAM_DHT_MAX_HZ 1   // O DHT11 precisa de 1 s entre leituras
+#define STREAM_FLUSH_BYTES 48 // Amostras acumuladas e enviadas em um único Serial.write()
+#define STREAM_FLUSH_US 20000 // ... ou depois deste tempo desde a primeira amostra acumulada
+#define STREAM_LINK_SHARE 2   // Os fluxos usam no máximo 1/2 da serial; o resto fica para as respostas
+
+struct StreamState {
+  uint32_t periodUs;  // 0: desligado
+  uint32_t nextUs;
+  bool binary;
+};
+
+StreamState streams[NCHANNELS];
+uint8_t streamBuf[128];
+size_t streamLen = 0;
+uint32_t streamFirstUs = 0;
+
+// Leituras dos sensores: a tarefa de sensores (SENSOR_CORE) lê o ADC e o DHT no seu próprio ritmo e
+// publica aqui; os comandos e o envio contínuo (loop(), no outro núcleo) só consultam a última leitura.
+// Uma transação lenta do DHT não atrasa mais nenhuma resposta
+#define SENSOR_CORE 0         // loop() roda no núcleo ARDUINO_RUNNING_CORE (1)
+#define SENSOR_STACK 4096
+#define LDR_PERIOD_MS 1       // Mais rápido que o maior STREAM_MAX_HZ
+#define DHT_PERIOD_MS 2000    // Intervalo entre leituras do DHT
+#define DHT_RETRY_MS 1000     // Nova tentativa depois de uma leitura com erro (o DHT11 precisa de 1 s)
+#define DHT_STALE_MS 10000    // Depois disso sem uma leitura boa, temperatura e umidade respondem com erro
+#define DHT_AGE_MAX INT16_MAX // A idade vai como valor de 16 bits nos quadros
+
+// Temperatura e umidade são a última leitura boa do DHT; as respostas informam a idade dela em ms
+// ("RES GET_TEMP 23.4 850"). Leituras com erro não apagam o valor anterior, só antecipam a próxima
+struct Readings {
+  int16_t ldr;     // 0 a 100
+  int16_t ldrRaw;  // Leitura filtrada do ADC, sem a escala de ldrMax (0 a 4095)
+  int16_t temp;    // Décimos de °C
+  int16_t hum;     // Décimos de %
+  uint32_t dhtMs;  // millis() da última leitura boa do DHT
+  bool dhtValid;   // Já houve uma leitura boa
+};
+
+// Declarados aqui para o Arduino não gerar os protótipos antes da struct
+void readingsPublish(const Readings &r);
+Readings readingsGet();
+int16_t dhtValue(const Readings &r, bool temp, int16_t *age);
+void dhtPoll(Readings &r);
+
+// Seqlock com um único escritor (a tarefa de sensores): seq ímpar durante a escrita. O leitor copia
+// readingsData e repete se seq mudou no meio, sem nunca bloquear o escritor
+std::atomic<uint32_t> readingsSeq(0);
+Readings readingsData = { 0, 0, VALUE_NAN, VALUE_NAN, 0, false };
+
+void readingsPublish(const Readings &r) {
+  uint32_t seq = readingsSeq.load(std::memory_order_relaxed);
+
+  readingsSeq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  readingsData = r;
+  readingsSeq.store(seq + 2, std::memory_order_release);
+}
+
+Readings readingsGet() {
+  Readings r;
+  uint32_t seq;
+
+  do {
+    seq = readingsSeq.load(std::memory_order_acquire);
+    r = readingsData;
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) || seq != readingsSeq.load(std::memory_order_relaxed));
+  return r;
+}
+
+// Temperatura (temp) ou umidade da última leitura boa e a idade dela em ms. VALUE_NAN se nunca houve
+// leitura boa ou se ela passou de DHT_STALE_MS (o sensor parou de responder)
+int16_t dhtValue(const Readings &r, bool temp, int16_t *age) {
+  uint32_t ms = millis() - r.dhtMs;
+
+  *age = min(ms, (uint32_t)DHT_AGE_MAX);
+  if (!r.dhtValid || ms > DHT_STALE_MS) {
+    return VALUE_NAN;
+  }
+  return temp ? r.temp : r.hum;
+}
 
-DHT dht(DHTPIN, DHTTYPE);
+void dhtBegin() {
+  rmtInit(DHTPIN, RMT_RX_MODE, RMT_MEM_NUM_BLOCKS_1, DHT_RMT_HZ);
+  rmtSetRxMinThreshold(DHTPIN, DHT_FILTER_US);
+  rmtSetRxMaxThreshold(DHTPIN, DHT_IDLE_US);
+
+  // Dreno aberto com entrada: o firmware pode baixar a linha sem tirar o pino do RMT (pinMode() tiraria)
+  gpio_set_direction((gpio_num_t)DHTPIN, GPIO_MODE_INPUT_OUTPUT_OD);
+  gpio_set_pull_mode((gpio_num_t)DHTPIN, GPIO_PULLUP_ONLY);
+  gpio_set_level((gpio_num_t)DHTPIN, 1);
+}
+
+// Decodifica a resposta capturada pelo RMT (durações em µs). Os 40 bits são os 40 últimos pulsos em 1: o
+// pulso em 1 de repouso, que termina a captura, vem com duração 0 e não conta. Retorna false se a
+// resposta está incompleta ou o checksum não confere
+bool dhtDecode(const rmt_data_t *symbols, size_t n, int16_t *temp, int16_t *hum) {
+  uint8_t data[5] = { 0 };
+  int bit = DHT_BITS;
+
+  for (int i = 2 * n - 1; i >= 0 && bit > 0; i--) {
+    const rmt_data_t &sym = symbols[i / 2];
+    bool high = i & 1 ? sym.level1 : sym.level0;
+    uint32_t us = i & 1 ? sym.duration1 : sym.duration0;
+    if (!high || !us) {
+      continue;
+    }
+    bit--;
+    if (us > DHT_BIT1_US) {
+      data[bit / 8] |= 0x80 >> (bit % 8);
+    }
+  }
+
+  if (bit > 0 || (uint8_t)(data[0] + data[1] + data[2] + data[3]) != data[4]) {
+    return false;
+  }
+
+  // Umidade e temperatura: parte inteira e décimos; o bit 7 dos décimos da temperatura é o sinal
+  *hum = data[0] * 10 + data[1];
+  *temp = data[2] * 10 + (data[3] & 0x0f);
+  if (data[3] & 0x80) {
+    *temp = -*temp;
+  }
+  return true;
+}
+
+// Avança a leitura do DHT um passo por volta da tarefa de sensores, sem esperar nada: o sinal de início,
+// a captura e a decodificação são etapas separadas, e o LDR continua sendo amostrado no meio delas
+void dhtPoll(Readings &r) {
+  enum { DHT_IDLE, DHT_START, DHT_RECV };
+  static int state = DHT_IDLE;
+  static uint32_t stateMs = millis() - DHT_PERIOD_MS;
+  static uint32_t waitMs = DHT_PERIOD_MS;
+  static rmt_data_t symbols[DHT_SYMBOLS];
+  static size_t nsymbols;
+  uint32_t now = millis();
+  int16_t temp, hum;
+  bool ok;
+
+  switch (state) {
+    case DHT_IDLE:
+      if (now - stateMs >= waitMs) {
+        gpio_set_level((gpio_num_t)DHTPIN, 0);  // Sinal de início
+        state = DHT_START;
+        stateMs = now;
+      }
+      return;
+    case DHT_START:
+      if (now - stateMs < DHT_START_MS) {
+        return;
+      }
+      // Arma a captura antes de soltar a linha: o sensor responde 20 a 40 µs depois
+      nsymbols = DHT_SYMBOLS;
+      ok = rmtReadAsync(DHTPIN, symbols, &nsymbols);
+      gpio_set_level((gpio_num_t)DHTPIN, 1);
+      if (ok) {
+        state = DHT_RECV;
+        stateMs = now;
+        return;
+      }
+      break;
+    case DHT_RECV:
+      ok = rmtReceiveCompleted(DHTPIN);
+      if (!ok && now - stateMs < DHT_TIMEOUT_MS) {
+        return;
+      }
+      ok = ok && dhtDecode(symbols, nsymbols, &temp, &hum);
+      if (ok) {
+        r.temp = temp;
+        r.hum = hum;
+        r.dhtMs = now;
+        r.dhtValid = true;
+      }
+      break;
+  }
+
+  // Fim da leitura. Com erro, tenta de novo mais cedo; o valor anterior continua valendo
+  waitMs = ok ? DHT_PERIOD_MS : DHT_RETRY_MS;
+  state = DHT_IDLE;
+  stateMs = now;
+}
+
+void sensorTask(void *arg) {
+  TickType_t wake = xTaskGetTickCount();
+  Readings r = readingsGet();
+
+  for (;;) {
+    r.ldrRaw = ldrFilter(ldrSample());
+    r.ldr = ldrPercent(r.ldrRaw);
+    dhtPoll(r);
+    readingsPublish(r);
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(LDR_PERIOD_MS));
+  }
+}
 
 void setup() {
-  dht.begin();
-  Serial.begin(9600);
-  pinMode(ledPin, OUTPUT);
+  dhtBegin();
+  Serial.begin(BOOT_BAUD);
+  // O callback roda na tarefa de eventos da UART assim que chegam bytes (FIFO cheia ou pausa na linha)
+  // e só acorda loop(), que trata os comandos: todo o estado continua com uma única tarefa
+  loopTask = xTaskGetCurrentTaskHandle();
+  Serial.onReceive(serialRxEvent);
+  ledcAttachChannel(ledPin, LED_PWM_FREQ, LED_PWM_BITS, LED_CHANNEL);
   pinMode(ldrPin, INPUT);
+  xTaskCreatePinnedToCore(sensorTask, "sensors", SENSOR_STACK, NULL, 1, NULL, SENSOR_CORE);
   Serial.printf("SmartLamp Initialized.\n");
   ledUpdate();
 }
 
 void loop() {
-  if (Serial.available()) {
-    String command = Serial.readStringUntil('\n');
-    processCommand(command);
+  serialRx();
+  if (baudSwitchMs && millis() - baudSwitchMs >= BAUD_CONFIRM_MS) {
+    setBaud(BOOT_BAUD);
+  }
+  streamPoll();
+
+  // Dorme até chegar um byte. Com envio contínuo (ou troca de velocidade) pendente, acorda a cada tick
+  // para as amostras; sem nada pendente, só a serial acorda o firmware
+  bool pending = streamLen > 0 || baudSwitchMs != 0;
+  for (int ch = CH_LDR; ch < NCHANNELS && !pending; ch++) {
+    pending = streams[ch].periodUs != 0;
   }
-  delay(100);
+  ulTaskNotifyTake(pdTRUE, pending ? 1 : portMAX_DELAY);
 }
 
-void processCommand(String command) {
-  command.trim();
+void serialRxEvent() {
+  xTaskNotifyGive(loopTask);
+}
+
+// Atende todos os comandos já recebidos: o driver pode enviar vários sem esperar as respostas.
+// Os bytes saem do buffer circular do driver da UART em blocos, direto para rxBuf, sem alocar memória
+void serialRx() {
+  uint8_t block[64];
+  size_t n;
 
-  if (command == "GET_LDR") {
-    int value = ldrGetValue();
-    Serial.printf("RES GET_LDR %d\n", value);
+  while ((n = Serial.read(block, sizeof(block))) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      rxByte(block[i]);
+    }
   }
-  else if (command == "GET_LED") {
-    int pwmValue = map(ledValue, 0, 100, 0, 255);
-    Serial.printf("RES GET_LED %d\n", pwmValue);
+}
+
+// Linhas de texto começam com um caractere imprimível e terminam em '\n'; quadros binários começam
+// com o código COBS (nunca imprimível) e terminam em 0. Cada comando é respondido no seu formato
+void rxByte(uint8_t b) {
+  bool frame = rxLen > 0 && !isprint(rxBuf[0]);
+
+  if (b == 0) {
+    if (frame) {
+      processFrame(rxBuf, rxLen);
+    }
+    rxLen = 0;
+  } else if (b == '\n' && !frame) {
+    if (rxLen > 0) {
+      rxBuf[rxLen] = '\0';
+      processCommand((char *)rxBuf);
+    }
+    rxLen = 0;
+  } else if (rxLen < sizeof(rxBuf) - 1) {
+    rxBuf[rxLen++] = b;
+  } else {
+    rxLen = 0;  // Comando longo demais: descarta
   }
-  else if (command.startsWith("SET_LED ")) {
-    String valueStr = command.substring(8);
-    int value = valueStr.toInt();
+}
+
+// Próximo campo da linha, separado por espaços. O campo é terminado com '\0' na própria linha
+char *nextToken(char **line) {
+  char *s = *line;
+
+  while (*s == ' ' || *s == '\t' || *s == '\r') s++;
+  char *token = s;
+  while (*s && *s != ' ' && *s != '\t' && *s != '\r') s++;
+  if (*s) *s++ = '\0';
+  *line = s;
+  return token;
+}
+
+// Converte um campo inteiro; false se vazio ou com lixo
+bool parseInt(const char *s, long *value) {
+  char *end;
+
+  *value = strtol(s, &end, 10);
+  return end != s && *end == '\0';
+}
+
+// Resposta de texto montada em um buffer fixo e enviada com um único Serial.write()
+char txBuf[80];
+size_t txLen = 0;
+
+void reply(const char *fmt, ...) {
+  va_list args;
+
+  va_start(args, fmt);
+  int n = vsnprintf(txBuf + txLen, sizeof(txBuf) - txLen, fmt, args);
+  va_end(args);
+  if (n > 0) {
+    txLen = min(txLen + n, sizeof(txBuf) - 1);
+  }
+}
+
+void replySend() {
+  Serial.write((const uint8_t *)txBuf, txLen);
+  txLen = 0;
+}
+
+// Valor em décimos no texto: 234 -> "23.4" (sem printf de float, que aloca memória na newlib)
+void replyTenths(int16_t value) {
+  if (value == VALUE_NAN) {
+    reply("nan");
+  } else {
+    reply("%s%d.%d", value < 0 ? "-" : "", abs(value) / 10, abs(value) % 10);
+  }
+}
 
-    if (value >= 0 && value <= 100) {
+void processCommand(char *line) {
+  // Comando com etiqueta ("#7 GET_LDR"): a resposta começa com a mesma etiqueta ("#7 RES GET_LDR 42")
+  char *command = nextToken(&line);
+  if (command[0] == '#') {
+    reply("%s ", command);
+    command = nextToken(&line);
+  }
+
+  char *arg1 = nextToken(&line);
+  char *arg2 = nextToken(&line);
+  long value, ms;
+
+  if (strcmp(command, "GET_LDR") == 0) {
+    reply("RES GET_LDR %d\n", readingsGet().ldr);
+  }
+  else if (strcmp(command, "GET_LDR_RAW") == 0) {
+    // Leitura filtrada do ADC com os 12 bits, para quem quer mais resolução que a porcentagem
+    reply("RES GET_LDR_RAW %d\n", readingsGet().ldrRaw);
+  }
+  else if (strcmp(command, "LDR_FILTER") == 0 && ldrFilterMode(arg1) >= 0 && parseInt(arg2, &value)) {
+    // "LDR_FILTER MEDIAN 5": responde com a janela aplicada ou -1
+    reply("RES LDR_FILTER %s %d\n", arg1, ldrSetFilter(ldrFilterMode(arg1), value));
+  }
+  else if (strcmp(command, "GET_LED") == 0) {
+    // Mesma escala do SET_LED (0 a 100), para o driver poder sincronizar sua cópia local
+    reply("RES GET_LED %d\n", ledValue);
+  }
+  else if (strcmp(command, "SET_LED_FADE") == 0 && *arg1) {
+    // "SET_LED_FADE 80 500": vai da intensidade atual a 80 em 500 ms, sem mais comandos do driver
+    bool ok = parseInt(arg1, &value) && parseInt(arg2, &ms) && ledFade(value, ms);
+    reply("RES SET_LED_FADE %s %d\n", arg1, ok ? 1 : -1);
+  }
+  else if (strcmp(command, "SET_LED") == 0 && *arg1) {
+    if (parseInt(arg1, &value) && value >= 0 && value <= 100) {
       ledValue = value;
       ledUpdate();
-      Serial.println("RES SET_LED 1");
+      reply("RES SET_LED 1\n");
     } else {
-      Serial.println("RES SET_LED -1");
+      reply("RES SET_LED -1\n");
     }
   }
-  else if (command == "GET_TEMP") {
-    float temperatura = dht.readTemperature();
-    if (isnan(temperatura)) {
-      Serial.println("ERR GET_TEMP Sensor error");
-    } else {
-      Serial.printf("RES GET_TEMP %.1f\n", temperatura);  // °C
+  else if (strcmp(command, "GET_ALL") == 0) {
+    // Todos os canais lidos no mesmo instante, em uma única linha: LED, LDR, temperatura e umidade
+    // seguidos da idade da leitura do DHT
+    Readings r = readingsGet();
+    int16_t age;
+    int16_t temp = dhtValue(r, true, &age);
+    int16_t hum = dhtValue(r, false, &age);
+    reply("RES GET_ALL %d %d ", ledValue, r.ldr);
+    replyTenths(temp);
+    reply(" ");
+    replyTenths(hum);
+    reply(" %d\n", age);
+  }
+  else if (strcmp(command, "STREAM_START") == 0 && streamChannel(arg1) >= 0 && parseInt(arg2, &value)) {
+    // "STREAM_START LDR 100": responde com a taxa aplicada, que pode ser menor que a pedida
+    reply("RES STREAM_START %s %d\n", arg1, streamStart(streamChannel(arg1), value, false));
+  }
+  else if (strcmp(command, "STREAM_STOP") == 0) {
+    streamStop();
+    reply("RES STREAM_STOP 1\n");
+  }
+  else if (strcmp(command, "BAUD") == 0 && parseInt(arg1, &value)) {
+    // Responde na velocidade atual e só então troca; o driver reprograma a ponte USB-serial ao receber
+    if (value == 9600 || value == 115200 || value == 230400 || value == 460800 || value == 921600) {
+      reply("RES BAUD %ld\n", value);
+      replySend();
+      setBaud(value);
+      return;
     }
+    reply("RES BAUD -1\n");
   }
-  else if (command == "GET_HUM") {
-    float umidade = dht.readHumidity();
-    if (isnan(umidade)) {
-      Serial.println("ERR GET_HUM Sensor error");
+  else if (strcmp(command, "BINARY") == 0 && *arg1) {
+    // O driver pergunta se o firmware entende quadros binários antes de usá-los
+    reply("RES BINARY %d\n", parseInt(arg1, &value) && value ? 1 : 0);
+  }
+  else if (strcmp(command, "GET_TEMP") == 0 || strcmp(command, "GET_HUM") == 0) {
+    // Do cache, sem esperar o sensor: "RES GET_TEMP 23.4 850" (°C ou %, idade em ms)
+    int16_t age;
+    int16_t reading = dhtValue(readingsGet(), strcmp(command, "GET_TEMP") == 0, &age);
+    if (reading == VALUE_NAN) {
+      reply("ERR %s Sensor error\n", command);
     } else {
-      Serial.printf("RES GET_HUM %.1f\n", umidade);  // %
+      reply("RES %s ", command);
+      replyTenths(reading);
+      reply(" %d\n", age);
     }
   }
   else {
-    Serial.println("ERR Unknown command.");
+    reply("ERR Unknown command.\n");
+    replySend();
+    return;
+  }
+  replySend();
+  baudSwitchMs = 0;  // Comando válido: o driver está na mesma velocidade
+}
+
+// Troca a velocidade da serial depois de enviar o que já está na fila de transmissão
+void setBaud(long baud) {
+  streamFlush();
+  Serial.flush();
+  Serial.updateBaudRate(baud);
+  serialBaud = baud;
+  baudSwitchMs = baud == BOOT_BAUD ? 0 : millis() | 1;
+
+  // Em uma velocidade menor, os fluxos ligados podem não caber mais
+  for (int ch = CH_LDR; ch < NCHANNELS; ch++) {
+    if (streams[ch].periodUs) {
+      streamStart(ch, 1000000UL / streams[ch].periodUs, streams[ch].binary);
+    }
   }
 }
 
+// Interrompe um fade em andamento; sem isso, o LEDC ignora novos valores até o fade terminar
+void ledFadeStop() {
+  // O serviço de fade do LEDC só existe depois do primeiro ledcFade(); antes, ledc_fade_stop() falha e o
+  // IDF registra o erro na UART0, que é a serial do protocolo
+  if (!ledFading) {
+    return;
+  }
+  ledFading = false;
+  ledc_fade_stop((ledc_mode_t)(LED_CHANNEL / SOC_LEDC_CHANNEL_NUM),
+                 (ledc_channel_t)(LED_CHANNEL % SOC_LEDC_CHANNEL_NUM));
+}
+
 void ledUpdate() {
-  int pwmValue = map(ledValue, 0, 100, 0, 255);
-  analogWrite(ledPin, pwmValue);
+  ledFadeStop();
+  ledcWrite(ledPin, gammaTable[ledValue]);
 }
 
-int ldrGetValue() {
-  int raw = analogRead(ldrPin);
+// Começa um fade da intensidade atual até target (0 a 100) em ms milissegundos, no hardware do LEDC.
+// O LEDC varia o duty linearmente entre os extremos já corrigidos pela gama. Retorna false se inválido
+bool ledFade(int target, int ms) {
+  if (target < 0 || target > 100 || ms < 0 || ms > LED_FADE_MAX_MS) {
+    return false;
+  }
+
+  ledFadeStop();
+  ledValue = target;
+  if (ms == 0) {
+    ledcWrite(ledPin, gammaTable[target]);
+    return true;
+  }
+  ledFading = ledcFade(ledPin, ledcRead(ledPin), gammaTable[target], ms);
+  return ledFading;
+}
+
+// Média de LDR_OVERSAMPLE conversões do ADC (0 a 4095)
+uint16_t ldrSample() {
+  uint32_t sum = 0;
+
+  for (int i = 0; i < LDR_OVERSAMPLE; i++) {
+    sum += analogRead(ldrPin);
+  }
+  return (sum + LDR_OVERSAMPLE / 2) / LDR_OVERSAMPLE;
+}
+
+// Aplica o filtro escolhido às últimas amostras. Chamado só pela tarefa de sensores
+uint16_t ldrFilter(uint16_t sample) {
+  static uint16_t history[LDR_WINDOW_MAX];
+  static int pos = 0;
+  uint16_t cfg = ldrFilterCfg.load(std::memory_order_relaxed);
+  int mode = cfg >> 8, n = cfg & 0xff;
+  uint16_t window[LDR_WINDOW_MAX];
+  uint32_t sum = 0;
+
+  history[pos] = sample;
+  pos = (pos + 1) % LDR_WINDOW_MAX;
+  if (mode == LDR_FILTER_NONE || n <= 1) {
+    return sample;
+  }
+
+  // Últimas n amostras, da mais nova para a mais velha
+  for (int i = 0; i < n; i++) {
+    window[i] = history[(pos - 1 - i + LDR_WINDOW_MAX) % LDR_WINDOW_MAX];
+    sum += window[i];
+  }
+  if (mode == LDR_FILTER_AVG) {
+    return (sum + n / 2) / n;
+  }
+
+  // Mediana: ordenação por inserção, barata para n <= LDR_WINDOW_MAX
+  for (int i = 1; i < n; i++) {
+    uint16_t v = window[i];
+    int j = i;
+    for (; j > 0 && window[j - 1] > v; j--) {
+      window[j] = window[j - 1];
+    }
+    window[j] = v;
+  }
+  return window[n / 2];
+}
+
+// Escolhe o filtro do LDR ("NONE", "AVG" ou "MEDIAN") e a janela. Retorna a janela aplicada ou -1
+int ldrSetFilter(int mode, long n) {
+  if (mode < LDR_FILTER_NONE || mode > LDR_FILTER_MEDIAN || n < 1 || n > LDR_WINDOW_MAX) {
+    return -1;
+  }
+  ldrFilterCfg.store(LDR_FILTER_CFG(mode, n), std::memory_order_relaxed);
+  return n;
+}
+
+// Modo do filtro pelo nome usado em LDR_FILTER; -1 se desconhecido
+int ldrFilterMode(const char *name) {
+  if (strcmp(name, "NONE") == 0) return LDR_FILTER_NONE;
+  if (strcmp(name, "AVG") == 0) return LDR_FILTER_AVG;
+  if (strcmp(name, "MEDIAN") == 0) return LDR_FILTER_MEDIAN;
+  return -1;
+}
+
+// Leitura do ADC em porcentagem da calibração (ldrMax)
+int16_t ldrPercent(uint16_t raw) {
   if (ldrMax <= 0) ldrMax = 4000;
   int percent = map(raw, 0, ldrMax, 0, 100);
   return constrain(percent, 0, 100);
 }
+
+// Trata um quadro binário (sem o delimitador 0). Quadros corrompidos são ignorados: o driver reenvia
+void processFrame(const uint8_t *frame, size_t len) {
+  uint8_t payload[FRAME_MAX];
+  int n = cobsDecode(frame, len, payload, sizeof(payload));
+
+  if (n < 4 || (n & 1) || crc16(payload, n - 2) != (payload[n - 2] | payload[n - 1] << 8)) {
+    return;
+  }
+
+  baudSwitchMs = 0;  // Quadro com CRC válido: o driver está na mesma velocidade
+
+  uint8_t op = payload[0];
+  uint8_t seq = payload[1];
+  int16_t value = n > 4 ? (int16_t)(payload[2] | payload[3] << 8) : 0;
+
+  switch (op) {
+    case OP_GET_LED:
+      sendValue(op, seq, ledValue);
+      break;
+    case OP_SET_LED:
+      if (value >= 0 && value <= 100) {
+        ledValue = value;
+        ledUpdate();
+        sendValue(op, seq, 1);
+      } else {
+        sendValue(op, seq, -1);
+      }
+      break;
+    case OP_SET_LED_FADE: {
+      // Valores: intensidade final e duração em ms
+      int16_t ms = n > 6 ? (int16_t)(payload[4] | payload[5] << 8) : -1;
+      sendValue(op, seq, ledFade(value, ms) ? 1 : -1);
+      break;
+    }
+    case OP_GET_LDR:
+      sendValue(op, seq, readingsGet().ldr);
+      break;
+    case OP_GET_LDR_RAW:
+      sendValue(op, seq, readingsGet().ldrRaw);
+      break;
+    case OP_LDR_FILTER: {
+      // Valores: modo (LDR_FILTER_*) e janela; a resposta traz a janela aplicada
+      int16_t window = n > 6 ? (int16_t)(payload[4] | payload[5] << 8) : -1;
+      sendValue(op, seq, ldrSetFilter(value, window));
+      break;
+    }
+    case OP_GET_TEMP:
+    case OP_GET_HUM: {
+      // Ponto fixo em décimos (23.4 °C -> 234) seguido da idade da leitura em ms
+      int16_t values[2];
+      values[0] = dhtValue(readingsGet(), op == OP_GET_TEMP, &values[1]);
+      if (values[0] == VALUE_NAN) {
+        sendError(op, seq);
+      } else {
+        sendFrame(op | OP_RES, seq, values, 2);
+      }
+      break;
+    }
+    case OP_GET_ALL: {
+      // Mesma ordem dos canais do driver: LED, LDR, temperatura e umidade (em décimos), seguidos da
+      // idade da leitura do DHT
+      Readings r = readingsGet();
+      int16_t values[5] = { (int16_t)ledValue, r.ldr };
+      values[2] = dhtValue(r, true, &values[4]);
+      values[3] = dhtValue(r, false, &values[4]);
+      sendFrame(op | OP_RES, seq, values, 5);
+      break;
+    }
+    case OP_STREAM_START: {
+      // Valores: canal e taxa em Hz; a resposta traz a taxa aplicada
+      int16_t hz = n > 6 ? (int16_t)(payload[4] | payload[5] << 8) : -1;
+      if (n <= 6 || value < CH_LDR || value > CH_HUM) {
+        sendError(op, seq);
+      } else {
+        sendValue(op, seq, streamStart(value, hz, true));
+      }
+      break;
+    }
+    case OP_STREAM_STOP:
+      streamStop();
+      sendValue(op, seq, 1);
+      break;
+    default: {
+      int16_t code = ERR_UNKNOWN;
+      sendFrame(op | OP_ERR, seq, &code, 1);
+      break;
+    }
+  }
+}
+
+void sendValue(uint8_t op, uint8_t seq, int16_t value) {
+  sendFrame(op | OP_RES, seq, &value, 1);
+}
+
+void sendError(uint8_t op, uint8_t seq) {
+  sendFrame(op | OP_ERR, seq, NULL, 0);
+}
+
+void sendFrame(uint8_t op, uint8_t seq, const int16_t *values, int nvalues) {
+  uint8_t out[FRAME_MAX + 2];
+
+  Serial.write(out, buildFrame(op, seq, values, nvalues, out));
+}
+
+// Monta um quadro: código, etiqueta, valores e CRC, codificado com COBS e terminado em 0.
+// out precisa de FRAME_MAX + 2 bytes. Retorna o tamanho do quadro
+size_t buildFrame(uint8_t op, uint8_t seq, const int16_t *values, int nvalues, uint8_t *out) {
+  uint8_t payload[FRAME_MAX];
+  int len = 0;
+
+  payload[len++] = op;
+  payload[len++] = seq;
+  for (int i = 0; i < nvalues; i++) {
+    payload[len++] = values[i] & 0xff;
+    payload[len++] = (values[i] >> 8) & 0xff;
+  }
+  uint16_t crc = crc16(payload, len);
+  payload[len++] = crc & 0xff;
+  payload[len++] = crc >> 8;
+
+  return cobsEncode(payload, len, out);
+}
+
+// Canal do driver pelo nome usado em STREAM_START ("LDR", "TEMP" ou "HUM"); -1 se desconhecido
+int streamChannel(const char *name) {
+  if (strcmp(name, "LDR") == 0) return CH_LDR;
+  if (strcmp(name, "TEMP") == 0) return CH_TEMP;
+  if (strcmp(name, "HUM") == 0) return CH_HUM;
+  return -1;
+}
+
+// Bytes de uma amostra no lote: quadro COBS (valores, etiqueta, CRC, código COBS e delimitador) ou a
+// maior linha de texto ("RES GET_LDR 100\n", "RES GET_TEMP -12.3 10000\n")
+int streamSampleBytes(int ch, bool binary) {
+  if (binary) {
+    return ch == CH_LDR ? 8 : 10;
+  }
+  return ch == CH_LDR ? 16 : 25;
+}
+
+// Liga (hz > 0) ou desliga o envio contínuo de um canal. A taxa é limitada pelo sensor e pelo que a
+// velocidade atual da serial comporta (10 bits por byte em 8N1), descontando os outros fluxos ligados.
+// Retorna a taxa aplicada
+int streamStart(int ch, int hz, bool binary) {
+  int maxHz = ch == CH_LDR ? STREAM_MAX_HZ : STREAM_DHT_MAX_HZ;
+  long budget = serialBaud / 10 / STREAM_LINK_SHARE;  // Bytes por segundo
+
+  for (int other = CH_LDR; other < NCHANNELS; other++) {
+    if (other != ch && streams[other].periodUs) {
+      budget -= 1000000L / streams[other].periodUs * streamSampleBytes(other, streams[other].binary);
+    }
+  }
+  maxHz = min<long>(maxHz, max<long>(budget, 0) / streamSampleBytes(ch, binary));
+
+  hz = constrain(hz, 0, maxHz);
+  streams[ch].periodUs = hz ? 1000000UL / hz : 0;
+  streams[ch].nextUs = micros();
+  streams[ch].binary = binary;
+  return hz;
+}
+
+void streamStop() {
+  for (int ch = 0; ch < NCHANNELS; ch++) {
+    streams[ch].periodUs = 0;
+  }
+  streamFlush();
+}
+
+// Acumula as amostras vencidas em streamBuf e envia o lote quando ele enche ou fica velho: menos
+// chamadas a Serial.write() e pacotes USB maiores em taxas altas
+void streamPoll() {
+  uint32_t now = micros();
+
+  for (int ch = CH_LDR; ch < NCHANNELS; ch++) {
+    StreamState &st = streams[ch];
+    if (!st.periodUs || (int32_t)(now - st.nextUs) < 0) {
+      continue;
+    }
+    st.nextUs += st.periodUs;
+    if ((int32_t)(now - st.nextUs) > 0) {
+      st.nextUs = now + st.periodUs;  // Atrasado (comando lento ou DHT): não tenta recuperar as amostras
+    }
+    streamSample(ch, st.binary);
+  }
+
+  if (streamLen > 0 && (streamLen >= STREAM_FLUSH_BYTES || now - streamFirstUs >= STREAM_FLUSH_US)) {
+    streamFlush();
+  }
+}
+
+// Acrescenta a última leitura do canal ao lote, no formato das respostas (temperatura e umidade com a
+// idade da leitura). DHT sem leitura boa recente não gera amostra
+void streamSample(int ch, bool binary) {
+  static const uint8_t ops[NCHANNELS] = { OP_GET_LED, OP_GET_LDR, OP_GET_TEMP, OP_GET_HUM };
+  static const char *const names[NCHANNELS] = { "GET_LED", "GET_LDR", "GET_TEMP", "GET_HUM" };
+  Readings r = readingsGet();
+  int16_t values[2];
+
+  values[0] = ch == CH_LDR ? r.ldr : dhtValue(r, ch == CH_TEMP, &values[1]);
+  if (values[0] == VALUE_NAN) return;
+
+  if (sizeof(streamBuf) - streamLen < FRAME_MAX + 2) {
+    streamFlush();
+  }
+  if (streamLen == 0) {
+    streamFirstUs = micros();
+  }
+
+  if (binary) {
+    streamLen += buildFrame(ops[ch] | OP_RES, STREAM_SEQ, values, ch == CH_LDR ? 1 : 2, streamBuf + streamLen);
+  } else if (ch == CH_LDR) {
+    streamLen += snprintf((char *)streamBuf + streamLen, sizeof(streamBuf) - streamLen, "RES %s %d\n",
+                          names[ch], values[0]);
+  } else {
+    streamLen += snprintf((char *)streamBuf + streamLen, sizeof(streamBuf) - streamLen, "RES %s %s%d.%d %d\n",
+                          names[ch], values[0] < 0 ? "-" : "", abs(values[0]) / 10, abs(values[0]) % 10,
+                          values[1]);
+  }
+}
+
+void streamFlush() {
+  if (streamLen > 0) {
+    Serial.write(streamBuf, streamLen);
+    streamLen = 0;
+  }
+}
+
+// CRC-16/CCITT refletido (polinômio 0x8408, início 0xFFFF): o mesmo de crc_ccitt() do kernel
+uint16_t crc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+
+  while (len--) {
+    crc ^= *data++;
+    for (int i = 0; i < 8; i++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+// Codifica com COBS, acrescentando o delimitador 0. out precisa de len + 2 bytes
+size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t codePos = 0, o = 1;
+  uint8_t code = 1;
+
+  for (size_t i = 0; i < len; i++) {
+    if (in[i] == 0) {
+      out[codePos] = code;
+      codePos = o++;
+      code = 1;
+      continue;
+    }
+    out[o++] = in[i];
+    if (++code == 0xFF) {
+      out[codePos] = code;
+      codePos = o++;
+      code = 1;
+    }
+  }
+  out[codePos] = code;
+  out[o++] = 0;
+  return o;
+}
+
+// Decodifica um quadro COBS. Retorna o tamanho decodificado ou -1 se o quadro é inválido
+int cobsDecode(const uint8_t *in, size_t len, uint8_t *out, size_t size) {
+  size_t i = 0, o = 0;
+
+  while (i < len) {
+    uint8_t code = in[i++];
+    if (code == 0 || i + code - 1 > len) {
+      return -1;
+    }
+    for (uint8_t j = 1; j < code; j++) {
+      if (o >= size) return -1;
+      out[o++] = in[i++];
+    }
+    if (code != 0xFF && i < len) {
+      if (o >= size) return -1;
+      out[o++] = 0;
+    }
+  }
+  return o;
+}